@@ -0,0 +1,289 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+#include "ecs_iterator.h"
+#include "entity_admin.h"
+
+using namespace ecs;
+
+//microbenchmarks of the core entity and query operations, the results are written as json.
+//ecs_bench [--quick] [--out results.json]
+//--quick skips the 1M entity runs. Every case runs in both storage modes and reports the best of
+//several repetitions, the setup of a repetition is not timed.
+
+namespace
+{
+	class MovementComponent : public BaseComponent
+	{
+	public:
+		void Reset(float velocity) { this->velocity = velocity; }
+		float velocity;
+	};
+	class HealthComponent : public BaseComponent
+	{
+	public:
+		void Reset(float hp, float mana)
+		{
+			this->hp = hp;
+			this->mana = mana;
+		}
+		float hp;
+		float mana;
+	};
+	class PositionComponent : public BaseComponent
+	{
+	public:
+		void Reset(float px, float py, float pz)
+		{
+			x = px;
+			y = py;
+			z = pz;
+		}
+		float x;
+		float y;
+		float z;
+	};
+
+	struct Result
+	{
+		std::string name;
+		const char* mode;
+		size_t entities;
+		int repetitions;
+		double best_ns;
+		double mean_ns;
+	};
+
+	using Clock = std::chrono::steady_clock;
+
+	//keeps the optimizer from dropping the loops
+	volatile float sink;
+
+	const char* ModeName(StorageMode mode)
+	{
+		return mode == StorageMode::kArchetype ? "archetype" : "component";
+	}
+
+	//count entities with movement and position, every other one with health as well
+	std::vector<EntityID> Populate(EntityAdmin& admin, size_t count)
+	{
+		std::vector<EntityID> ids;
+		ids.reserve(count);
+		for (size_t i = 0; i < count; ++i)
+		{
+			Entity& e = admin.CreateEntity<Entity>();
+			e.Add<MovementComponent>(float(i)).Add<PositionComponent>(0.f, 0.f, 0.f);
+			if (i % 2 == 0)
+			{
+				e.Add<HealthComponent>(100.f, 50.f);
+			}
+			ids.push_back(e.GetEntityID());
+		}
+		return ids;
+	}
+	//count entities with movement and position only
+	std::vector<EntityID> PopulateBare(EntityAdmin& admin, size_t count)
+	{
+		return admin.CreateEntities<MovementComponent, PositionComponent>(count);
+	}
+	std::vector<EntityID> Nothing(EntityAdmin&, size_t) { return std::vector<EntityID>(); }
+
+	class Bench
+	{
+	private:
+		std::vector<Result> results_;
+		std::vector<size_t> sizes_;
+
+	public:
+		explicit Bench(std::vector<size_t> sizes) : sizes_(std::move(sizes)) {}
+
+		//setup(admin, count) prepares a fresh admin and returns ids, body(admin, ids, count) is timed
+		template <typename Setup, typename Body>
+		void Run(const char* name, Setup setup, Body body)
+		{
+			const StorageMode modes[] = { StorageMode::kComponent, StorageMode::kArchetype };
+			for (StorageMode mode : modes)
+			{
+				for (size_t count : sizes_)
+				{
+					const int repetitions = count >= 1000000 ? 3 : 5;
+					double best = std::numeric_limits<double>::max();
+					double total = 0.0;
+					for (int rep = 0; rep < repetitions; ++rep)
+					{
+						EntityAdmin admin(mode);
+						std::vector<EntityID> ids = setup(admin, count);
+						Clock::time_point start = Clock::now();
+						body(admin, ids, count);
+						const double ns = double(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+						best = std::min(best, ns);
+						total += ns;
+					}
+					results_.push_back(Result{ name, ModeName(mode), count, repetitions, best, total / repetitions });
+					std::cerr << name << ' ' << ModeName(mode) << ' ' << count << ": " << best / count << " ns/entity" << std::endl;
+				}
+			}
+		}
+
+		void WriteJson(std::ostream& out) const
+		{
+			out << std::fixed << std::setprecision(3);
+			out << "{\n  \"benchmarks\": [\n";
+			for (size_t i = 0; i < results_.size(); ++i)
+			{
+				const Result& r = results_[i];
+				out << "    { \"name\": \"" << r.name << "\", \"mode\": \"" << r.mode << "\", \"entities\": " << r.entities
+					<< ", \"repetitions\": " << r.repetitions << ", \"best_ns\": " << r.best_ns << ", \"mean_ns\": " << r.mean_ns
+					<< ", \"ns_per_entity\": " << r.best_ns / r.entities << " }" << (i + 1 < results_.size() ? "," : "") << "\n";
+			}
+			out << "  ]\n}\n";
+		}
+	};
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<size_t> sizes = { 1000, 100000, 1000000 };
+	const char* out_path = nullptr;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (std::strcmp(argv[i], "--quick") == 0)
+		{
+			sizes.pop_back();
+		}
+		else if (std::strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+		{
+			out_path = argv[++i];
+		}
+		else
+		{
+			std::cerr << "usage: ecs_bench [--quick] [--out results.json]" << std::endl;
+			return 1;
+		}
+	}
+
+	Bench bench(sizes);
+
+	bench.Run("create_destroy", Nothing, [](EntityAdmin& admin, std::vector<EntityID>&, size_t count) {
+		std::vector<EntityID> ids = Populate(admin, count);
+		for (EntityID id : ids)
+		{
+			admin.DestroyEntity(id);
+		}
+	});
+	bench.Run("create_bulk", Nothing, [](EntityAdmin& admin, std::vector<EntityID>&, size_t count) {
+		admin.CreateEntities<MovementComponent, PositionComponent>(count);
+	});
+	bench.Run("destroy_bulk", Populate, [](EntityAdmin& admin, std::vector<EntityID>& ids, size_t) {
+		admin.DestroyEntities(ids);
+	});
+	bench.Run("add_remove", PopulateBare, [](EntityAdmin& admin, std::vector<EntityID>& ids, size_t) {
+		for (EntityID id : ids)
+		{
+			admin.FindEntity(id)->Add<HealthComponent>(1.f, 1.f);
+		}
+		for (EntityID id : ids)
+		{
+			admin.FindEntity(id)->Remove<HealthComponent>();
+		}
+	});
+	bench.Run("replace", Populate, [](EntityAdmin& admin, std::vector<EntityID>& ids, size_t) {
+		for (EntityID id : ids)
+		{
+			admin.FindEntity(id)->Replace<PositionComponent>(1.f, 2.f, 3.f);
+		}
+	});
+	bench.Run("get", Populate, [](EntityAdmin& admin, std::vector<EntityID>& ids, size_t) {
+		float sum = 0.f;
+		for (EntityID id : ids)
+		{
+			sum += admin.FindEntity(id)->Get<PositionComponent>()->x;
+		}
+		sink = sum;
+	});
+	bench.Run("has", Populate, [](EntityAdmin& admin, std::vector<EntityID>& ids, size_t) {
+		size_t count = 0;
+		for (EntityID id : ids)
+		{
+			count += admin.FindEntity(id)->Has<MovementComponent, HealthComponent>() ? 1 : 0;
+		}
+		sink = float(count);
+	});
+	bench.Run("find_entity", Populate, [](EntityAdmin& admin, std::vector<EntityID>& ids, size_t) {
+		size_t count = 0;
+		for (EntityID id : ids)
+		{
+			count += admin.FindEntity(id) ? 1 : 0;
+		}
+		sink = float(count);
+	});
+	bench.Run("iterate_single", Populate, [](EntityAdmin& admin, std::vector<EntityID>&, size_t) {
+		for (PositionComponent* p : MakeComponentItr<PositionComponent>(&admin))
+		{
+			p->x += 1.f;
+		}
+	});
+	bench.Run("iterate_multi", Populate, [](EntityAdmin& admin, std::vector<EntityID>&, size_t) {
+		for (auto&& t : MakeComponentItr<MovementComponent, PositionComponent>(&admin))
+		{
+			std::get<1>(t)->x += std::get<0>(t)->velocity;
+		}
+	});
+	bench.Run("iterate_single_legacy", Populate, [](EntityAdmin& admin, std::vector<EntityID>&, size_t) {
+		for (PositionComponent* p : ComponentItr<PositionComponent>(&admin))
+		{
+			p->x += 1.f;
+		}
+	});
+	bench.Run("iterate_multi_legacy", Populate, [](EntityAdmin& admin, std::vector<EntityID>&, size_t) {
+		for (auto&& t : ComponentItr<MovementComponent, PositionComponent>(&admin))
+		{
+			std::get<1>(t)->x += std::get<0>(t)->velocity;
+		}
+	});
+	bench.Run("iterate_predicate", Populate, [](EntityAdmin& admin, std::vector<EntityID>&, size_t) {
+		auto fast = [](MovementComponent* m, PositionComponent*) { return m->velocity > 10.f; };
+		for (auto&& t : MakeComponentItr<MovementComponent, PositionComponent>(&admin, fast))
+		{
+			std::get<1>(t)->x += std::get<0>(t)->velocity;
+		}
+	});
+	bench.Run("iterate_function_predicate", Populate, [](EntityAdmin& admin, std::vector<EntityID>&, size_t) {
+		ComponentItr<MovementComponent, PositionComponent> itr(&admin, [](MovementComponent* m, PositionComponent*) { return m->velocity > 10.f; });
+		for (auto&& t : itr)
+		{
+			std::get<1>(t)->x += std::get<0>(t)->velocity;
+		}
+	});
+	bench.Run("sibling", Populate, [](EntityAdmin& admin, std::vector<EntityID>&, size_t) {
+		float sum = 0.f;
+		for (MovementComponent* m : MakeComponentItr<MovementComponent>(&admin))
+		{
+			HealthComponent* h = m->Sibling<HealthComponent>();
+			sum += h ? h->hp : m->Sibling<PositionComponent>()->x;
+		}
+		sink = sum;
+	});
+
+	if (out_path)
+	{
+		std::ofstream out(out_path);
+		bench.WriteJson(out);
+		if (!out)
+		{
+			std::cerr << "cannot write " << out_path << std::endl;
+			return 1;
+		}
+	}
+	else
+	{
+		bench.WriteJson(std::cout);
+	}
+	return 0;
+}
@@ -0,0 +1,266 @@
+#include "archetype_storage.h"
+#include "entity.h"
+#include <algorithm>
+
+using namespace ecs;
+
+constexpr size_t Archetype::kChunkBytes;
+
+namespace
+{
+	size_t AlignUp(size_t value, size_t alignment)
+	{
+		return (value + alignment - 1) & ~(alignment - 1);
+	}
+}
+
+Archetype::Archetype(const ComponentMask& mask, const std::vector<ComponentTypeInfo>& infos, const std::atomic<version_t>* clock)
+	: mask_(mask), clock_(clock)
+{
+	size_t row_bytes = sizeof(Entity*);
+	for (index_t id = 0; id < infos.size(); ++id)
+	{
+		if (mask.test(id))
+		{
+			types_.push_back(id);
+			infos_.push_back(infos[id]);
+			row_bytes += infos[id].size;
+		}
+	}
+	//every column starts on its own cache line
+	const size_t padding = BaseComponentStorage::kCacheLineSize * (types_.size() + 1);
+	capacity_ = kChunkBytes > padding + row_bytes ? (kChunkBytes - padding) / row_bytes : 1;
+
+	size_t offset = AlignUp(capacity_ * sizeof(Entity*), BaseComponentStorage::kCacheLineSize);
+	for (const ComponentTypeInfo& info : infos_)
+	{
+		offsets_.push_back(offset);
+		offset = AlignUp(offset + capacity_ * info.size, BaseComponentStorage::kCacheLineSize);
+	}
+	chunk_bytes_ = offset;
+	row_versions_.resize(types_.size());
+	//deques of atomics cannot be moved element by element, build them in place
+	chunk_versions_ = std::vector<std::deque<std::atomic<version_t>>>(types_.size());
+}
+
+Archetype::~Archetype()
+{
+	for (size_t row = 0; row < size_; ++row)
+	{
+		for (size_t column = 0; column < types_.size(); ++column)
+		{
+			infos_[column].destroy(At(row, column));
+		}
+	}
+	for (char* chunk : chunks_)
+	{
+		details::AlignedFree(chunk);
+	}
+}
+
+int Archetype::ColumnOf(index_t id) const
+{
+	auto it = std::lower_bound(types_.begin(), types_.end(), id);
+	return (it != types_.end() && *it == id) ? int(it - types_.begin()) : -1;
+}
+
+void Archetype::AddChunk()
+{
+	chunks_.push_back(static_cast<char*>(details::AlignedAlloc(chunk_bytes_, BaseComponentStorage::kCacheLineSize)));
+	for (std::deque<std::atomic<version_t>>& versions : chunk_versions_)
+	{
+		versions.emplace_back(0);
+	}
+}
+
+size_t Archetype::PushRow(Entity* owner)
+{
+	if (size_ == chunks_.size() * capacity_)
+	{
+		AddChunk();
+	}
+	size_t row = size_++;
+	OwnerAt(row) = owner;
+	const version_t now = Now();
+	for (size_t column = 0; column < types_.size(); ++column)
+	{
+		row_versions_[column].push_back(0);
+		Stamp(row, column, now);
+	}
+	return row;
+}
+
+void Archetype::Reserve(size_t rows)
+{
+	while (chunks_.size() * capacity_ < size_ + rows)
+	{
+		AddChunk();
+	}
+	for (std::vector<version_t>& versions : row_versions_)
+	{
+		versions.reserve(size_ + rows);
+	}
+}
+
+void Archetype::Stamp(size_t row, size_t column, version_t version)
+{
+	row_versions_[column][row] = version;
+	std::atomic<version_t>& chunk = chunk_versions_[column][row / capacity_];
+	version_t newest = chunk.load(std::memory_order_relaxed);
+	while (newest < version && !chunk.compare_exchange_weak(newest, version, std::memory_order_relaxed))
+	{
+	}
+}
+
+void Archetype::PopRow(size_t row)
+{
+	size_t last = size_ - 1;
+	if (row != last)
+	{
+		for (size_t column = 0; column < types_.size(); ++column)
+		{
+			infos_[column].relocate(At(row, column), At(last, column));
+			Stamp(row, column, row_versions_[column][last]);
+		}
+		OwnerAt(row) = OwnerAt(last);
+		Rebind(row);
+	}
+	for (std::vector<version_t>& versions : row_versions_)
+	{
+		versions.pop_back();
+	}
+	--size_;
+}
+
+void Archetype::Rebind(size_t row) const
+{
+	Entity* owner = OwnerAt(row);
+	owner->archetype_ = const_cast<Archetype*>(this);
+	owner->row_ = row;
+	for (size_t column = 0; column < types_.size(); ++column)
+	{
+		owner->RebindComponent(types_[column], At(row, column));
+	}
+}
+
+void ArchetypeStorage::Remove(Entity* owner, index_t id)
+{
+	Archetype* current = owner->archetype_;
+	if (!current || current->ColumnOf(id) < 0)
+	{
+		return;
+	}
+	if (current->types_.size() == 1)
+	{
+		RemoveAll(owner);
+		return;
+	}
+	Move(owner, Transition(current, id, false));
+}
+
+void ArchetypeStorage::RemoveAll(Entity* owner)
+{
+	Archetype* current = owner->archetype_;
+	if (!current)
+	{
+		return;
+	}
+	size_t row = owner->row_;
+	for (size_t column = 0; column < current->types_.size(); ++column)
+	{
+		current->infos_[column].destroy(current->At(row, column));
+	}
+	current->PopRow(row);
+	owner->archetype_ = nullptr;
+	owner->row_ = 0;
+}
+
+Archetype* ArchetypeStorage::FindOrCreate(const ComponentMask& mask)
+{
+	auto it = lookup_.find(mask);
+	if (it != lookup_.end())
+	{
+		return it->second;
+	}
+	archetypes_.emplace_back(new Archetype(mask, infos_, clock_));
+	Archetype* archetype = archetypes_.back().get();
+	lookup_.insert(std::make_pair(mask, archetype));
+	return archetype;
+}
+
+Archetype* ArchetypeStorage::Transition(Archetype* from, index_t id, bool add)
+{
+	if (!from)
+	{
+		ComponentMask mask;
+		mask.set(id);
+		return FindOrCreate(mask);
+	}
+	std::vector<Archetype*>& edges = add ? from->add_edges_ : from->remove_edges_;
+	if (edges.size() <= id)
+	{
+		edges.resize(id + 1, nullptr);
+	}
+	if (!edges[id])
+	{
+		ComponentMask mask = from->mask_;
+		mask.set(id, add);
+		edges[id] = FindOrCreate(mask);
+	}
+	return edges[id];
+}
+
+void ArchetypeStorage::Move(Entity* owner, Archetype* target)
+{
+	Archetype* current = owner->archetype_;
+	size_t row = target->PushRow(owner);
+	if (current)
+	{
+		size_t prev_row = owner->row_;
+		for (size_t column = 0; column < current->types_.size(); ++column)
+		{
+			int target_column = target->ColumnOf(current->types_[column]);
+			if (target_column >= 0)
+			{
+				current->infos_[column].relocate(target->At(row, target_column), current->At(prev_row, column));
+				target->Stamp(row, target_column, current->row_versions_[column][prev_row]);
+			}
+			else
+			{
+				current->infos_[column].destroy(current->At(prev_row, column));
+			}
+		}
+		current->PopRow(prev_row);
+	}
+	target->Rebind(row);
+}
+
+char* ArchetypeStorage::Insert(Entity* owner, index_t id)
+{
+	Archetype* target = Transition(owner->archetype_, id, true);
+	Move(owner, target);
+	return target->At(owner->row_, target->ColumnOf(id));
+}
+
+void ArchetypeStorage::Touch(Entity* owner, index_t id)
+{
+	Archetype* archetype = owner->archetype_;
+	int column = archetype ? archetype->ColumnOf(id) : -1;
+	if (column >= 0)
+	{
+		archetype->Touch(owner->row_, column);
+	}
+}
+
+version_t ArchetypeStorage::Version(const Entity* owner, index_t id) const
+{
+	const Archetype* archetype = owner->archetype_;
+	int column = archetype ? archetype->ColumnOf(id) : -1;
+	return column >= 0 ? archetype->Version(owner->row_, column) : 0;
+}
+
+void ArchetypeStorage::SetLocation(Entity* owner, Archetype* archetype, size_t row)
+{
+	owner->archetype_ = archetype;
+	owner->row_ = row;
+}
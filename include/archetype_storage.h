@@ -0,0 +1,200 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <tuple>
+#include <vector>
+#include <unordered_map>
+#include "ecs_functional.h"
+#include "component_storage.h"
+
+namespace ecs
+{
+	class Entity;
+
+	//type erased operations an archetype needs to move components between chunks
+	struct ComponentTypeInfo
+	{
+		size_t size{ 0 };
+		size_t align{ 0 };
+		void(*relocate)(void* dst, void* src){ nullptr };
+		void(*destroy)(void* component){ nullptr };
+
+		template <class C>
+		static ComponentTypeInfo Make()
+		{
+			ComponentTypeInfo info;
+			info.size = sizeof(C);
+			info.align = alignof(C);
+			info.relocate = [](void* dst, void* src) { details::RelocateComponent(static_cast<C*>(dst), static_cast<C*>(src)); };
+			info.destroy = [](void* component) { static_cast<C*>(component)->~C(); };
+			return info;
+		}
+	};
+
+	//all entities that own exactly the same set of components. Rows are packed into
+	//fixed-size chunks, every chunk holds the owners followed by one array per component type.
+	class Archetype
+	{
+		friend class ArchetypeStorage;
+	public:
+		static constexpr size_t kChunkBytes = 16 * 1024;
+
+	private:
+		ComponentMask mask_;
+		ComponentIndexList types_;
+		std::vector<ComponentTypeInfo> infos_;
+		std::vector<size_t> offsets_;
+		size_t capacity_{ 0 };
+		size_t chunk_bytes_{ 0 };
+		size_t size_{ 0 };
+		std::vector<char*> chunks_;
+		std::vector<Archetype*> add_edges_;
+		std::vector<Archetype*> remove_edges_;
+		//version of the last write by column and row, and the newest of them by column and chunk
+		const std::atomic<version_t>* clock_;
+		std::vector<std::vector<version_t>> row_versions_;
+		std::vector<std::deque<std::atomic<version_t>>> chunk_versions_;
+
+	public:
+		Archetype(const ComponentMask& mask, const std::vector<ComponentTypeInfo>& infos, const std::atomic<version_t>* clock = nullptr);
+		~Archetype();
+		Archetype(const Archetype&) = delete;
+		Archetype& operator=(const Archetype&) = delete;
+
+		const ComponentMask& Mask() const { return mask_; }
+		size_t size() const { return size_; }
+
+		size_t ChunkCount() const { return (size_ + capacity_ - 1) / capacity_; }
+		size_t ChunkSize(size_t chunk) const
+		{
+			size_t first = chunk * capacity_;
+			return size_ - first < capacity_ ? size_ - first : capacity_;
+		}
+		Entity* const* ChunkOwners(size_t chunk) const { return reinterpret_cast<Entity* const*>(chunks_[chunk]); }
+		char* ChunkColumn(size_t chunk, size_t column) const { return chunks_[chunk] + offsets_[column]; }
+		//column of a component type, -1 if the archetype does not contain it
+		int ColumnOf(index_t id) const;
+
+		size_t ChunkCapacity() const { return capacity_; }
+		version_t Version(size_t row, size_t column) const { return row_versions_[column][row]; }
+		version_t ChunkVersion(size_t chunk, size_t column) const { return chunk_versions_[column][chunk].load(std::memory_order_relaxed); }
+		const version_t* ChunkVersions(size_t chunk, size_t column) const { return row_versions_[column].data() + chunk * capacity_; }
+		//records a write to the component of row in column
+		void Touch(size_t row, size_t column) { Stamp(row, column, Now()); }
+
+	private:
+		char* At(size_t row, size_t column) const
+		{
+			return chunks_[row / capacity_] + offsets_[column] + (row % capacity_) * infos_[column].size;
+		}
+		Entity*& OwnerAt(size_t row) const
+		{
+			return reinterpret_cast<Entity**>(chunks_[row / capacity_])[row % capacity_];
+		}
+		version_t Now() const { return clock_ ? clock_->load(std::memory_order_relaxed) : 0; }
+		void Stamp(size_t row, size_t column, version_t version);
+		void AddChunk();
+		//a new row counts as written in every column
+		size_t PushRow(Entity* owner);
+		//allocates chunks up front so that the next rows rows do not allocate
+		void Reserve(size_t rows);
+		//the components of row were already destroyed or moved out, fill the hole with the last row
+		void PopRow(size_t row);
+		//tells the owner of row where its components live now
+		void Rebind(size_t row) const;
+	};
+
+	using ArchetypeList = std::vector<std::unique_ptr<Archetype>>;
+
+	class ArchetypeStorage
+	{
+	private:
+		std::vector<ComponentTypeInfo> infos_;
+		ArchetypeList archetypes_;
+		std::unordered_map<ComponentMask, Archetype*> lookup_;
+		const std::atomic<version_t>* clock_{ nullptr };
+
+	public:
+		ArchetypeStorage() = default;
+		ArchetypeStorage(const ArchetypeStorage&) = delete;
+		ArchetypeStorage& operator=(const ArchetypeStorage&) = delete;
+
+		template <class C>
+		void Register(index_t id);
+		template <class C, typename... Args>
+		C* Create(Entity* owner, Args&&... args);
+		template <class C, typename... Args>
+		C* Replace(C* component, Args&&... args);
+		void Remove(Entity* owner, index_t id);
+		void RemoveAll(Entity* owner);
+		//the archetype of exactly Cs with room for reserve more rows
+		template <class... Cs>
+		Archetype* Prepare(size_t reserve);
+		//puts an entity without components into a new row of target, Cs are default constructed
+		template <class... Cs>
+		std::tuple<Cs*...> Emplace(Archetype* target, Entity* owner);
+
+		const ArchetypeList& Archetypes() const { return archetypes_; }
+		void SetClock(const std::atomic<version_t>* clock) { clock_ = clock; }
+		//records a write to the component id of owner
+		void Touch(Entity* owner, index_t id);
+		version_t Version(const Entity* owner, index_t id) const;
+
+	private:
+		Archetype* FindOrCreate(const ComponentMask& mask);
+		Archetype* Transition(Archetype* from, index_t id, bool add);
+		//moves the components of owner into a new row of target, components not in target are destroyed
+		void Move(Entity* owner, Archetype* target);
+		//moves owner to the archetype that also has id, returns the uninitialized slot for it
+		char* Insert(Entity* owner, index_t id);
+		static void SetLocation(Entity* owner, Archetype* archetype, size_t row);
+	};
+
+	template <class C>
+	void ArchetypeStorage::Register(index_t id)
+	{
+		if (id >= infos_.size())
+		{
+			infos_.resize(id + 1);
+		}
+		if (infos_[id].size == 0)
+		{
+			infos_[id] = ComponentTypeInfo::Make<C>();
+		}
+	}
+
+	template <class C, typename... Args>
+	C* ArchetypeStorage::Create(Entity* owner, Args&&... args)
+	{
+		index_t id = details::ComponentIndex::index<C>();
+		Register<C>(id);
+		return details::ConstructComponent<C>(Insert(owner, id), std::forward<Args>(args)...);
+	}
+
+	template <class... Cs>
+	Archetype* ArchetypeStorage::Prepare(size_t reserve)
+	{
+		int expand[] = { 0, (Register<Cs>(details::ComponentIndex::index<Cs>()), 0)... };
+		(void)expand;
+		Archetype* target = FindOrCreate(details::ComponentMaskOf<Cs...>());
+		target->Reserve(reserve);
+		return target;
+	}
+
+	template <class... Cs>
+	std::tuple<Cs*...> ArchetypeStorage::Emplace(Archetype* target, Entity* owner)
+	{
+		size_t row = target->PushRow(owner);
+		SetLocation(owner, target, row);
+		return std::tuple<Cs*...>{ new (target->At(row, target->ColumnOf(details::ComponentIndex::index<Cs>()))) Cs()... };
+	}
+
+	template <class C, typename... Args>
+	C* ArchetypeStorage::Replace(C* component, Args&&... args)
+	{
+		component->~C();
+		return details::ConstructComponent<C>(component, std::forward<Args>(args)...);
+	}
+}
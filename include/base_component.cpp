@@ -2,7 +2,7 @@
 
 using namespace ecs;
 
-BaseComponent* BaseComponent::SiblingComponent(const index_t index)
+void* BaseComponent::SiblingComponent(const index_t index)
 {
 	return ent_ ? ent_->GetComponent(index) : nullptr;
 }
\ No newline at end of file
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <new>
+#include <cstring>
+#include <utility>
 #include "ecs_functional.h"
 
 namespace ecs
@@ -22,13 +25,80 @@ namespace ecs
         template <typename C>
         C const* As() const;
 
+		//valid as long as a pointer from Entity::Get
 		template<class C>
 		C* Sibling();
 
 	private:
-		BaseComponent* SiblingComponent(const index_t index);
+		void* SiblingComponent(const index_t index);
     };
 
+	//empty plain structs are tags, an entity owns one through a bit of its signature only
+	template <typename T>
+	struct IsTag : std::integral_constant<bool, std::is_empty<T>::value && !std::is_same<BaseComponent, T>::value> {};
+
+	//components either derive from BaseComponent or are plain structs. Plain ones carry no vtable
+	//and no owner pointer, the storage knows the owner of every slot instead.
+	namespace details
+	{
+		//tags have no state, every owner shares this instance
+		template <class T>
+		T* TagInstance()
+		{
+			static T instance;
+			return &instance;
+		}
+
+		inline void SetOwner(BaseComponent* component, Entity* owner) { component->SetOwner(owner); }
+		inline void SetOwner(void*, Entity*) {}
+
+		template <class C, typename... Args>
+		using ConstructTag = std::integral_constant<int,
+			std::is_base_of<BaseComponent, C>::value ? 0 : std::is_constructible<C, Args...>::value ? 1 : 2>;
+
+		//BaseComponent types are default constructed and Reset, the others are built from the arguments
+		template <class C, typename... Args>
+		C* Construct(void* where, std::integral_constant<int, 0>, Args&&... args)
+		{
+			C* component = new (where) C();
+			component->Reset(std::forward<Args>(args)...);
+			return component;
+		}
+		template <class C, typename... Args>
+		C* Construct(void* where, std::integral_constant<int, 1>, Args&&... args)
+		{
+			return new (where) C(std::forward<Args>(args)...);
+		}
+		template <class C, typename... Args>
+		C* Construct(void* where, std::integral_constant<int, 2>, Args&&... args)
+		{
+			return new (where) C{ std::forward<Args>(args)... };
+		}
+		template <class C, typename... Args>
+		C* ConstructComponent(void* where, Args&&... args)
+		{
+			return Construct<C>(where, ConstructTag<C, Args...>(), std::forward<Args>(args)...);
+		}
+
+		//moves *from into the uninitialized *to and destroys *from, trivially copyable types are copied bytewise
+		template <class C>
+		void RelocateComponent(C* to, C* from, std::true_type)
+		{
+			std::memcpy(static_cast<void*>(to), static_cast<const void*>(from), sizeof(C));
+		}
+		template <class C>
+		void RelocateComponent(C* to, C* from, std::false_type)
+		{
+			new (to) C(std::move(*from));
+			from->~C();
+		}
+		template <class C>
+		void RelocateComponent(C* to, C* from)
+		{
+			RelocateComponent(to, from, std::is_trivially_copyable<C>());
+		}
+	}
+
 	template <typename C>
 	C* BaseComponent::As()
 	{
@@ -47,7 +117,6 @@ namespace ecs
 	C* BaseComponent::Sibling()
 	{
 		ECS_ASSERT_IS_COMPONENT(C);
-		BaseComponent* component = SiblingComponent(details::ComponentIndex::index<C>());
-		return component ? component->As<C>() : nullptr;
+		return static_cast<C*>(SiblingComponent(details::ComponentIndex::index<C>()));
 	}
 }
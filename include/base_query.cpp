@@ -0,0 +1,49 @@
+#include "base_query.h"
+#include "entity.h"
+
+using namespace ecs;
+
+constexpr index_t BaseQuery::kInvalidPosition;
+
+bool BaseQuery::Contains(const Entity* ent) const
+{
+	index_t entity_index = EntityIndex(ent->GetEntityID());
+	return entity_index < positions_.size() && positions_[entity_index] != kInvalidPosition
+		&& entities_[positions_[entity_index]] == ent;
+}
+
+void BaseQuery::Update(Entity* ent)
+{
+	bool contained = Contains(ent);
+	bool matches = Matches(ent->Signature());
+	if (matches && !contained)
+	{
+		Insert(ent, EntityIndex(ent->GetEntityID()));
+		OnEnter(ent);
+	}
+	else if (!matches && contained)
+	{
+		Erase(EntityIndex(ent->GetEntityID()));
+		OnLeave(ent);
+	}
+}
+
+void BaseQuery::Insert(Entity* ent, index_t entity_index)
+{
+	if (entity_index >= positions_.size())
+	{
+		positions_.resize(entity_index + 1, kInvalidPosition);
+	}
+	positions_[entity_index] = index_t(entities_.size());
+	entities_.push_back(ent);
+}
+
+void BaseQuery::Erase(index_t entity_index)
+{
+	index_t position = positions_[entity_index];
+	Entity* last = entities_.back();
+	entities_[position] = last;
+	positions_[EntityIndex(last->GetEntityID())] = position;
+	positions_[entity_index] = kInvalidPosition;
+	entities_.pop_back();
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <vector>
+#include "ecs_define.h"
+
+namespace ecs
+{
+	class Entity;
+
+	//keeps a dense list of the entities whose signature contains the query mask and none of the
+	//excluded bits. the list is updated whenever the signature of an entity changes.
+	class BaseQuery
+	{
+	public:
+		static constexpr index_t kInvalidPosition = index_t(-1);
+
+	protected:
+		ComponentMask mask_;
+		ComponentMask excluded_;
+		std::vector<Entity*> entities_;
+		//position in entities_ by entity index
+		std::vector<index_t> positions_;
+
+	public:
+		BaseQuery(const ComponentMask& mask, const ComponentMask& excluded) : mask_(mask), excluded_(excluded) {}
+		virtual ~BaseQuery() = default;
+		BaseQuery(const BaseQuery&) = delete;
+		BaseQuery& operator=(const BaseQuery&) = delete;
+
+		const ComponentMask& Mask() const { return mask_; }
+		const ComponentMask& Excluded() const { return excluded_; }
+		size_t size() const { return entities_.size(); }
+		bool empty() const { return entities_.empty(); }
+		const std::vector<Entity*>& Entities() const { return entities_; }
+
+		bool Contains(const Entity* ent) const;
+		bool Matches(const ComponentMask& signature) const { return (signature & mask_) == mask_ && (signature & excluded_).none(); }
+		//adds or removes the entity depending on its current signature
+		void Update(Entity* ent);
+
+	protected:
+		//the entity started or stopped matching
+		virtual void OnEnter(Entity*) {}
+		virtual void OnLeave(Entity*) {}
+
+	private:
+		void Insert(Entity* ent, index_t entity_index);
+		void Erase(index_t entity_index);
+	};
+}
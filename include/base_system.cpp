@@ -6,4 +6,13 @@ using namespace ecs;
 BaseSystem::BaseSystem(EntityAdmin* admin) : admin_(admin)
 {
 
-}
\ No newline at end of file
+}
+
+bool BaseSystem::ConflictsWith(const BaseSystem& other) const
+{
+	if (Exclusive() || other.Exclusive())
+	{
+		return true;
+	}
+	return (writes_ & (other.reads_ | other.writes_)).any() || (other.writes_ & reads_).any();
+}
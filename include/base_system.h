@@ -1,16 +1,40 @@
 #pragma once
 
+#include "ecs_functional.h"
+
 namespace ecs
 {
 	class EntityAdmin;
 	class BaseSystem
 	{
+		friend class SystemScheduler;
 	protected:
 		EntityAdmin* admin_{ nullptr };
+	private:
+		//component types the system reads and writes, the scheduler runs systems whose sets do not conflict in parallel
+		ComponentMask reads_;
+		ComponentMask writes_;
+		//the change version when the last run ended, 0 before the first run
+		version_t last_run_version_{ 0 };
 	public:
 		BaseSystem(EntityAdmin* admin);
 		virtual ~BaseSystem() = default;
 
 		virtual void Update(float time_step) {}
+
+		const ComponentMask& Reads() const { return reads_; }
+		const ComponentMask& Writes() const { return writes_; }
+		//a system that declares nothing may touch anything, it never runs alongside another system
+		bool Exclusive() const { return reads_.none() && writes_.none(); }
+		bool ConflictsWith(const BaseSystem& other) const;
+		//Changed<T> terms match components written after this version
+		version_t LastRunVersion() const { return last_run_version_; }
+
+	protected:
+		//called from the constructor of the derived system, Cs may also be singleton types
+		template <typename... Cs>
+		void Read() { reads_ |= details::ComponentMaskOf<Cs...>(); }
+		template <typename... Cs>
+		void Write() { writes_ |= details::ComponentMaskOf<Cs...>(); }
 	};
-}
\ No newline at end of file
+}
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <tuple>
+#include "base_query.h"
+#include "query_terms.h"
+#include "worker_pool.h"
+#include "entity.h"
+
+namespace ecs
+{
+	//a registered query, see EntityAdmin::Query. Iterating it only visits matching entities,
+	//the membership test happens when components are added or removed.
+	//Args are component types or Exclude<...> / Optional<...> / Mut<...> terms. A query of tags only yields
+	//no pointers, Entities() lists the matches. Changed<...> needs a ComponentItr, the match list
+	//does not follow writes.
+	template <typename... Args>
+	class CachedQuery : public BaseQuery
+	{
+		static_assert(details::conjunction_v<std::integral_constant<bool, details::QueryTerm<Args>::kValid>...> && (details::RequiredCount<Args...>() + details::TagCount<Args...>() > 0), "invalid argument type!");
+		static_assert(details::ChangedCount<Args...>() == 0, "Changed terms are only supported by ComponentItr!");
+		using EntityIterator = std::vector<Entity*>::const_iterator;
+		using Yield = details::QueryYield<Args...>;
+		using TagDispatchType = std::conditional_t<(std::tuple_size<Yield>::value == 1), std::true_type, std::false_type>;
+
+		class ItemIterator
+		{
+		private:
+			EntityIterator it_;
+		public:
+			explicit ItemIterator(EntityIterator it) : it_(it) {}
+
+			bool operator!=(const ItemIterator& rhs) const { return it_ != rhs.it_; }
+			decltype(auto) operator*() const { return get(TagDispatchType()); }
+			ItemIterator& operator++()
+			{
+				++it_;
+				return *this;
+			}
+		private:
+			std::tuple_element_t<0, Yield> get(std::true_type&&) const { return std::get<0>(get(std::false_type())); }
+			Yield get(std::false_type&&) const
+			{
+				details::TouchTerms<Args...>(*it_);
+				return details::FetchTerms<Args...>(*it_);
+			}
+		};
+
+	public:
+		CachedQuery() : BaseQuery(details::QueryMasks<Args...>::Get().required, details::QueryMasks<Args...>::Get().excluded) {}
+
+		ItemIterator begin() const { return ItemIterator(entities_.begin()); }
+		ItemIterator end() const { return ItemIterator(entities_.end()); }
+
+		//calls f with the yielded pointers of every matching entity
+		template <typename F>
+		void ForEach(F&& f) const
+		{
+			for (Entity* ent : entities_)
+			{
+				details::TouchTerms<Args...>(ent);
+				Invoke(f, details::FetchTerms<Args...>(ent), std::make_index_sequence<std::tuple_size<Yield>::value>());
+			}
+		}
+
+		//calls group(const T&) once for every distinct value of Shared<T> among the matching entities,
+		//then f(pointers...) for the entities that share it. Entities without a value are skipped.
+		template <typename T, typename G, typename F>
+		void ForEachGroup(G&& group, F&& f) const
+		{
+			//counting sort by the dense group of the values
+			std::vector<index_t> groups(entities_.size());
+			index_t group_count = 0;
+			for (size_t i = 0; i < entities_.size(); ++i)
+			{
+				const Shared<T>* shared = entities_[i]->template Get<Shared<T>>();
+				groups[i] = shared ? shared->Group() : Shared<T>::kNoGroup;
+				if (groups[i] != Shared<T>::kNoGroup && groups[i] >= group_count)
+				{
+					group_count = groups[i] + 1;
+				}
+			}
+			std::vector<size_t> offsets(group_count + 1, 0);
+			for (index_t g : groups)
+			{
+				if (g != Shared<T>::kNoGroup)
+				{
+					++offsets[g + 1];
+				}
+			}
+			for (index_t g = 0; g < group_count; ++g)
+			{
+				offsets[g + 1] += offsets[g];
+			}
+			std::vector<Entity*> order(offsets.back());
+			std::vector<size_t> cursor(offsets.begin(), offsets.end() - 1);
+			for (size_t i = 0; i < entities_.size(); ++i)
+			{
+				if (groups[i] != Shared<T>::kNoGroup)
+				{
+					order[cursor[groups[i]]++] = entities_[i];
+				}
+			}
+			for (index_t g = 0; g < group_count; ++g)
+			{
+				if (offsets[g] == offsets[g + 1])
+				{
+					continue;
+				}
+				group(**order[offsets[g]]->template Get<Shared<T>>());
+				for (size_t i = offsets[g]; i < offsets[g + 1]; ++i)
+				{
+					details::TouchTerms<Args...>(order[i]);
+					Invoke(f, details::FetchTerms<Args...>(order[i]), std::make_index_sequence<std::tuple_size<Yield>::value>());
+				}
+			}
+		}
+
+		//splits the matching entities into ranges of grain entities that run on the pool, or on the
+		//calling thread when pool is null. f(scratch, pointers...) gets the scratch of the thread
+		//running the range; every scratch starts as a copy of init and they are merged with
+		//reduce(Scratch& into, const Scratch& from) in worker order, so init must be neutral for reduce.
+		//f must not add or remove components of the queried types.
+		template <typename Scratch, typename F, typename R>
+		Scratch ParallelForEach(WorkerPool* pool, const Scratch& init, F&& f, R&& reduce, size_t grain = kParallelGrain) const
+		{
+			//padded so neighbouring threads do not write the same cache line
+			struct Slot
+			{
+				Scratch value;
+				char padding[64];
+			};
+			std::vector<Slot> slots(pool ? pool->Size() + 1 : 1, Slot{ init, {} });
+			auto body = [this, &f, &slots](size_t begin, size_t end, size_t worker) {
+				Scratch& scratch = slots[worker].value;
+				for (size_t i = begin; i < end; ++i)
+				{
+					details::TouchTerms<Args...>(entities_[i]);
+					Invoke(f, scratch, details::FetchTerms<Args...>(entities_[i]), std::make_index_sequence<std::tuple_size<Yield>::value>());
+				}
+			};
+			if (pool)
+			{
+				pool->ParallelFor(entities_.size(), grain, body);
+			}
+			else
+			{
+				body(0, entities_.size(), 0);
+			}
+			Scratch result = slots[0].value;
+			for (size_t i = 1; i < slots.size(); ++i)
+			{
+				reduce(result, slots[i].value);
+			}
+			return result;
+		}
+
+		//calls f(pointers...) for every matching entity, spread over the pool
+		template <typename F>
+		void ParallelForEach(WorkerPool* pool, F&& f, size_t grain = kParallelGrain) const
+		{
+			ParallelForEach(pool, NoScratch(), [&f](NoScratch&, auto... ptrs) { f(ptrs...); }, [](NoScratch&, const NoScratch&) {}, grain);
+		}
+
+		static constexpr size_t kParallelGrain = 1024;
+
+	private:
+		struct NoScratch {};
+
+		template <typename F, size_t... I>
+		static void Invoke(F& f, const Yield& t, std::index_sequence<I...>)
+		{
+			f(std::get<I>(t)...);
+		}
+		template <typename F, typename Scratch, size_t... I>
+		static void Invoke(F& f, Scratch& scratch, const Yield& t, std::index_sequence<I...>)
+		{
+			f(scratch, std::get<I>(t)...);
+		}
+	};
+
+	template <typename... Args>
+	constexpr size_t CachedQuery<Args...>::kParallelGrain;
+}
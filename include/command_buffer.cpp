@@ -0,0 +1,168 @@
+#include "command_buffer.h"
+#include "entity_admin.h"
+#include <algorithm>
+
+using namespace ecs;
+
+constexpr size_t CommandBuffer::kBlockBytes;
+
+CommandBuffer::~CommandBuffer()
+{
+	Clear();
+}
+
+DeferredEntity CommandBuffer::Create()
+{
+	DeferredEntity ent{ created_++ };
+	Record(Op::kCreate, true, 0, ent.index, nullptr);
+	return ent;
+}
+
+void CommandBuffer::Clear()
+{
+	for (Command& command : commands_)
+	{
+		if (command.payload)
+		{
+			command.payload->~Payload();
+		}
+	}
+	commands_.clear();
+	created_ = 0;
+	//the first block is kept for the next frame, it holds at least kBlockBytes
+	if (blocks_.size() > 1)
+	{
+		blocks_.resize(1);
+	}
+	block_bytes_ = kBlockBytes;
+	block_used_ = 0;
+}
+
+void CommandBuffer::Swap(CommandBuffer& other)
+{
+	commands_.swap(other.commands_);
+	std::swap(created_, other.created_);
+	blocks_.swap(other.blocks_);
+	std::swap(block_bytes_, other.block_bytes_);
+	std::swap(block_used_, other.block_used_);
+}
+
+void* CommandBuffer::Allocate(size_t size, size_t alignment)
+{
+	if (!blocks_.empty())
+	{
+		uintptr_t begin = reinterpret_cast<uintptr_t>(blocks_.back().get());
+		uintptr_t address = (begin + block_used_ + alignment - 1) & ~(uintptr_t(alignment) - 1);
+		if (address + size <= begin + block_bytes_)
+		{
+			block_used_ = size_t(address + size - begin);
+			return reinterpret_cast<void*>(address);
+		}
+	}
+	//a payload larger than a block gets a block of its own
+	block_bytes_ = std::max(kBlockBytes, size + alignment);
+	blocks_.emplace_back(new char[block_bytes_]);
+	block_used_ = 0;
+	return Allocate(size, alignment);
+}
+
+void CommandBuffer::Playback(EntityAdmin& admin, CommandBuffer* const* buffers, size_t count)
+{
+	struct Entry
+	{
+		const Command* command;
+		EntityID entity;
+		size_t buffer;
+		size_t sequence;
+	};
+	//the commands and payloads are taken out, buffers[i] records into fresh storage meanwhile
+	std::vector<std::unique_ptr<CommandBuffer>> taken(count);
+	for (size_t buffer = 0; buffer < count; ++buffer)
+	{
+		taken[buffer].reset(new CommandBuffer());
+		taken[buffer]->Swap(*buffers[buffer]);
+	}
+	std::vector<Entry> entries;
+	std::vector<std::vector<Entity*>> created(count);
+	for (size_t buffer = 0; buffer < count; ++buffer)
+	{
+		const std::vector<Command>& commands = taken[buffer]->commands_;
+		created[buffer].reserve(taken[buffer]->created_);
+		for (size_t sequence = 0; sequence < commands.size(); ++sequence)
+		{
+			if (commands[sequence].op == Op::kCreate)
+			{
+				created[buffer].push_back(&admin.CreateEntity<Entity>());
+			}
+			else
+			{
+				entries.push_back(Entry{ &commands[sequence], kInvalidEntityID, buffer, sequence });
+			}
+		}
+	}
+	for (Entry& entry : entries)
+	{
+		const Command& command = *entry.command;
+		entry.entity = command.deferred ? created[entry.buffer][size_t(command.target)]->GetEntityID() : command.target;
+	}
+	//grouped by component type so each storage is touched in one run, in entity order, destructions last.
+	//The commands on one component of one entity stay in recording order
+	std::sort(entries.begin(), entries.end(), [](const Entry& lhs, const Entry& rhs) {
+		const Command& l = *lhs.command;
+		const Command& r = *rhs.command;
+		if ((l.op == Op::kDestroy) != (r.op == Op::kDestroy)) return r.op == Op::kDestroy;
+		if (l.component != r.component) return l.component < r.component;
+		EntityID li = EntityIndex(lhs.entity);
+		EntityID ri = EntityIndex(rhs.entity);
+		if (li != ri) return li < ri;
+		if (lhs.entity != rhs.entity) return lhs.entity < rhs.entity;
+		if (lhs.buffer != rhs.buffer) return lhs.buffer < rhs.buffer;
+		return lhs.sequence < rhs.sequence;
+	});
+	for (size_t i = 0; i < entries.size(); ++i)
+	{
+		const Entry& entry = entries[i];
+		const Command& command = *entry.command;
+		//the last addition or removal of the component decides, the earlier ones are dropped
+		if (command.op != Op::kDestroy && i + 1 < entries.size())
+		{
+			const Entry& next = entries[i + 1];
+			if (next.command->op != Op::kDestroy && next.command->component == command.component && next.entity == entry.entity)
+			{
+				continue;
+			}
+		}
+		//looked up again as an earlier command may have destroyed it
+		Entity* ent = admin.FindEntity(entry.entity);
+		if (!ent)
+		{
+			continue;
+		}
+		switch (command.op)
+		{
+		case Op::kRemove:
+			if (ent->HasComponent(command.component))
+			{
+				ent->RemoveComponent(command.component);
+			}
+			break;
+		case Op::kAdd:
+			command.payload->Apply(*ent);
+			break;
+		case Op::kDestroy:
+			admin.DestroyEntity(entry.entity);
+			break;
+		default:
+			break;
+		}
+	}
+	for (size_t buffer = 0; buffer < count; ++buffer)
+	{
+		taken[buffer]->Clear();
+		//nothing was recorded meanwhile, the buffer gets its memory back
+		if (buffers[buffer]->commands_.empty() && buffers[buffer]->blocks_.empty())
+		{
+			buffers[buffer]->Swap(*taken[buffer]);
+		}
+	}
+}
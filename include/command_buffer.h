@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <tuple>
+#include <vector>
+#include "entity.h"
+
+namespace ecs
+{
+	class EntityAdmin;
+
+	//an entity created by a CommandBuffer, it exists once the buffer is played back
+	struct DeferredEntity
+	{
+		size_t index;
+	};
+
+	//records structural changes and applies them later at a sync point, see EntityAdmin::Commands.
+	//Iterators stay valid while commands are recorded; playback sorts the commands so creations run
+	//first, then removals and additions grouped by component type, then destructions. Of the removals
+	//and additions of one component on one entity only the last recorded one is applied.
+	//Commands on entities that are gone by then are skipped.
+	class CommandBuffer
+	{
+	private:
+		enum class Op : uint8_t
+		{
+			kCreate,
+			kRemove,
+			kAdd,
+			kDestroy,
+		};
+
+		struct Payload
+		{
+			virtual ~Payload() = default;
+			virtual void Apply(Entity& ent) = 0;
+		};
+
+		//the component arguments are kept by value until playback
+		template <typename T, typename... Args>
+		struct AddPayload : Payload
+		{
+			std::tuple<Args...> args;
+
+			template <typename... Ts>
+			explicit AddPayload(Ts&&... ts) : args(std::forward<Ts>(ts)...) {}
+			void Apply(Entity& ent) override { Apply(ent, std::index_sequence_for<Args...>()); }
+
+			template <size_t... I>
+			void Apply(Entity& ent, std::index_sequence<I...>) { ent.Replace<T>(std::move(std::get<I>(args))...); }
+		};
+
+		struct Command
+		{
+			Op op;
+			bool deferred;
+			index_t component;
+			//entity id, or the DeferredEntity index when deferred
+			EntityID target;
+			Payload* payload;
+		};
+
+		static constexpr size_t kBlockBytes = 4096;
+
+		std::vector<Command> commands_;
+		size_t created_{ 0 };
+		//payloads are bump allocated in blocks and destroyed after playback
+		std::vector<std::unique_ptr<char[]>> blocks_;
+		size_t block_bytes_{ kBlockBytes };
+		size_t block_used_{ 0 };
+
+	public:
+		CommandBuffer() = default;
+		~CommandBuffer();
+		CommandBuffer(const CommandBuffer&) = delete;
+		CommandBuffer& operator=(const CommandBuffer&) = delete;
+
+		DeferredEntity Create();
+		void Destroy(EntityID eid) { Record(Op::kDestroy, false, 0, eid, nullptr); }
+
+		//adds T, or replaces it when the entity already has one by then
+		template <typename T, typename... Args>
+		void Add(EntityID eid, Args&&... args) { AddTo<T>(false, eid, std::forward<Args>(args)...); }
+		template <typename T, typename... Args>
+		void Add(DeferredEntity ent, Args&&... args) { AddTo<T>(true, ent.index, std::forward<Args>(args)...); }
+
+		//does nothing when the entity has no T by then
+		template <typename T>
+		void Remove(EntityID eid) { Record(Op::kRemove, false, details::ComponentIndex::index<T>(), eid, nullptr); }
+
+		size_t size() const { return commands_.size(); }
+		bool empty() const { return commands_.empty(); }
+		void Clear();
+
+		//plays back and clears the buffers as one sorted batch, ties keep the buffer order.
+		//commands recorded while playing back, e.g. by observers, wait for the next playback
+		static void Playback(EntityAdmin& admin, CommandBuffer* const* buffers, size_t count);
+
+	private:
+		void Record(Op op, bool deferred, index_t component, EntityID target, Payload* payload)
+		{
+			commands_.push_back(Command{ op, deferred, component, target, payload });
+		}
+		void* Allocate(size_t size, size_t alignment);
+		void Swap(CommandBuffer& other);
+
+		template <typename T, typename... Args>
+		void AddTo(bool deferred, EntityID target, Args&&... args)
+		{
+			using PayloadType = AddPayload<T, std::decay_t<Args>...>;
+			void* memory = Allocate(sizeof(PayloadType), alignof(PayloadType));
+			Record(Op::kAdd, deferred, details::ComponentIndex::index<T>(), target, new (memory) PayloadType(std::forward<Args>(args)...));
+		}
+	};
+}
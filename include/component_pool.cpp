@@ -1,27 +1,111 @@
 #include "component_pool.h"
-#include <algorithm>
+#include "entity.h"
 using namespace ecs;
 
-void ComponentPool::RemoveComponent(index_t id, BaseComponent* component)
+void ComponentPool::RemoveComponent(Entity* owner, index_t id, void* component)
 {
 	if (!component)
 	{
 		return;
 	}
-	ComponentVector& component_vec = GetAllComponents(id);
-	auto it = std::find(component_vec.begin(), component_vec.end(), component);
-	assert(it != component_vec.end());
-	if (it != component_vec.end())
+	if (mode_ == StorageMode::kArchetype)
 	{
-		std::swap(*it, component_vec.back());
+		archetypes_.Remove(owner, id);
+		return;
+	}
+	BaseComponentStorage* storage = FindComponents(id);
+	assert(storage);
+	if (storage)
+	{
+		storage->Remove(owner);
+	}
+}
 
-		delete component_vec.back();
+void ComponentPool::Touch(Entity* owner, index_t id)
+{
+	if (mode_ == StorageMode::kArchetype)
+	{
+		archetypes_.Touch(owner, id);
+		return;
+	}
+	BaseComponentStorage* storage = FindComponents(id);
+	size_t index = storage ? storage->IndexOf(owner) : 0;
+	if (storage && index != storage->size())
+	{
+		storage->Touch(index);
+	}
+}
 
-		component_vec.pop_back();
+version_t ComponentPool::VersionOf(const Entity* owner, index_t id) const
+{
+	if (mode_ == StorageMode::kArchetype)
+	{
+		return archetypes_.Version(owner, id);
 	}
+	BaseComponentStorage* storage = FindComponents(id);
+	size_t index = storage ? storage->IndexOf(owner) : 0;
+	return (storage && index != storage->size()) ? storage->Version(index) : 0;
 }
 
-ComponentVector& ComponentPool::GetAllComponents(index_t id)
+void ComponentPool::RemoveAllComponents(Entity* owner)
 {
-	return component_pools_[id];
+	archetypes_.RemoveAll(owner);
+}
+
+void ComponentPool::RemoveAllComponents(const std::vector<Entity*>& owners)
+{
+	if (mode_ == StorageMode::kArchetype)
+	{
+		for (Entity* owner : owners)
+		{
+			archetypes_.RemoveAll(owner);
+		}
+		return;
+	}
+	std::vector<std::vector<Entity*>> by_type(component_pools_.size());
+	for (Entity* owner : owners)
+	{
+		ComponentMask signature = owner->Signature();
+		for (index_t index = 0; signature.any(); ++index)
+		{
+			if (signature.test(index))
+			{
+				signature.reset(index);
+				//tags have no storage
+				if (index < by_type.size() && component_pools_[index])
+				{
+					by_type[index].push_back(owner);
+				}
+			}
+		}
+	}
+	for (index_t index = 0; index < by_type.size(); ++index)
+	{
+		if (!by_type[index].empty())
+		{
+			component_pools_[index]->RemoveMany(by_type[index]);
+		}
+	}
+}
+
+void ComponentPool::AddQuery(index_t id, std::unique_ptr<BaseQuery> query)
+{
+	if (id >= queries_.size())
+	{
+		queries_.resize(id + 1);
+	}
+	//excluded bits change the membership as well
+	const ComponentMask watched = query->Mask() | query->Excluded();
+	for (index_t index = 0; index < watched.size(); ++index)
+	{
+		if (watched.test(index))
+		{
+			if (index >= component_queries_.size())
+			{
+				component_queries_.resize(index + 1);
+			}
+			component_queries_[index].push_back(query.get());
+		}
+	}
+	queries_[id] = std::move(query);
 }
@@ -1,35 +1,259 @@
 #pragma once
 
-#include <map>
+#include <atomic>
 #include <memory>
 #include <vector>
 #include "ecs_functional.h"
 #include "base_component.h"
+#include "component_storage.h"
+#include "archetype_storage.h"
+#include "shared_component.h"
+#include "base_query.h"
+#include "observer.h"
 
 namespace ecs
 {
 	class BaseComponent;
-	using ComponentVector = std::vector<BaseComponent*>;
+
+	//specialize as std::true_type for components that only live until the end of the next
+	//EntityAdmin::Update. Their storage blocks come from the frame arena and are dropped at once.
+	//One added directly by a system is only seen by the systems after it in the same frame, add it
+	//through EntityAdmin::Commands to have every system see it in the next one.
+	template <class C>
+	struct IsTransient : std::false_type {};
+
     class ComponentPool
     {
 	private:
-        std::map<index_t, ComponentVector> component_pools_;
+        StorageMode mode_;
+        //the change clock, see Touch
+        std::atomic<version_t> version_{ 1 };
+        //reset by EntityAdmin::Update once the transient components are gone,
+        //declared first as it must outlive the storages it backs
+        ArenaResource frame_arena_;
+        ComponentMask transient_types_;
+        //empty component types, they have no storage
+        ComponentMask tag_types_;
+        //by component index of the value type, must outlive the handles in the storages below
+        std::vector<std::unique_ptr<BaseSharedStorage>> shared_values_;
+        //indexed by component index, null until the type is registered or first used
+        std::vector<std::unique_ptr<BaseComponentStorage>> component_pools_;
+        ArchetypeStorage archetypes_;
+        //registered queries by query index, and the queries that use each component index
+        std::vector<std::unique_ptr<BaseQuery>> queries_;
+        std::vector<std::vector<BaseQuery*>> component_queries_;
+        ObserverList observers_;
 
     public:
+        explicit ComponentPool(StorageMode mode = StorageMode::kComponent) : mode_(mode) { archetypes_.SetClock(&version_); }
+
+        StorageMode Mode() const { return mode_; }
+
         template <class C, typename... Args>
-        BaseComponent* CreateComponent(Args&&... args);
-		void RemoveComponent(index_t id, BaseComponent* component);
+        C* CreateComponent(Entity* owner, Args&&... args) { return Create<C>(owner, IsShared<C>(), std::forward<Args>(args)...); }
+        template <class C, typename... Args>
+        C* ReplaceComponent(C* component, Args&&... args) { return Replace<C>(component, IsShared<C>(), std::forward<Args>(args)...); }
+		void RemoveComponent(Entity* owner, index_t id, void* component);
+		void RemoveAllComponents(Entity* owner);
+		//removes every component of many entities, grouped by storage in component mode.
+		//the entities still point at their components and must drop their slots.
+		void RemoveAllComponents(const std::vector<Entity*>& owners);
+
+        //creates the storage up front, optionally with room for reserve components.
+        //resource replaces ComponentResource<C> for the blocks of the storage
+        template <class C>
+        ComponentStorage<C>& RegisterComponent(size_t reserve = 0, MemoryResource* resource = nullptr);
+        template <class C>
+        ComponentStorage<C>& GetAllComponents();
+        template <class T>
+        SharedStorage<T>& GetSharedValues();
+        template <class T, typename... Args>
+        Shared<T> MakeShared(Args&&... args) { return GetSharedValues<T>().Intern(std::forward<Args>(args)...); }
+        BaseComponentStorage* FindComponents(index_t id) const
+        {
+            return id < component_pools_.size() ? component_pools_[id].get() : nullptr;
+        }
+        const ArchetypeList& GetArchetypes() const { return archetypes_.Archetypes(); }
+        const ComponentMask& TransientTypes() const { return transient_types_; }
+        //components record the current version when they are created or touched
+        version_t Version() const { return version_.load(std::memory_order_relaxed); }
+        //returns the current version and moves the clock on, later writes get a newer one
+        version_t AdvanceVersion() { return version_.fetch_add(1); }
+        std::atomic<version_t>& Clock() { return version_; }
+        //records a write to the component id of owner
+        void Touch(Entity* owner, index_t id);
+        //the version of the last write to the component id of owner, 0 when it has none
+        version_t VersionOf(const Entity* owner, index_t id) const;
+        template <class T>
+        void RegisterTag()
+        {
+            const index_t id = details::ComponentIndex::index<T>();
+            tag_types_.set(id);
+            transient_types_.set(id, transient_types_.test(id) || IsTransient<T>::value);
+        }
+        bool IsTag(index_t id) const { return tag_types_.test(id); }
+        ArenaResource& FrameArena() { return frame_arena_; }
+
+        //bulk creation: reserves room for count more entities with exactly Cs,
+        //the result is passed to EmplaceComponents and is null in component mode
+        template <class... Cs>
+        Archetype* ReserveComponents(size_t count);
+        //default constructs Cs for an entity without components, Reset is not called
+        template <class... Cs>
+        std::tuple<Cs*...> EmplaceComponents(Archetype* target, Entity* owner);
+
+        BaseQuery* FindQuery(index_t id) const
+        {
+            return id < queries_.size() ? queries_[id].get() : nullptr;
+        }
+        void AddQuery(index_t id, std::unique_ptr<BaseQuery> query);
+        //called by the entity after bit index of its signature changed
+        void OnSignatureChanged(Entity* owner, index_t index)
+        {
+            if (index < component_queries_.size())
+            {
+                for (BaseQuery* query : component_queries_[index])
+                {
+                    query->Update(owner);
+                }
+            }
+        }
 
-        ComponentVector& GetAllComponents(index_t id);
+        ObserverList& Observers() { return observers_; }
+        //called by the entity on lifecycle events, a bit test when nobody observes the type
+        bool Observes(ComponentEvent event, index_t index) const { return observers_.Watches(event, index); }
+        //an observer callback is running
+        bool Notifying() const { return observers_.Notifying(); }
+        void Notify(ComponentEvent event, Entity* owner, index_t index, void* component)
+        {
+            if (observers_.Watches(event, index))
+            {
+                observers_.Notify(event, *owner, index, component);
+            }
+        }
+
+    private:
+        //archetype chunks are shared, transient components are only removed in bulk there
+        template <class C>
+        void MarkTransient()
+        {
+            if (IsTransient<C>::value)
+            {
+                transient_types_.set(details::ComponentIndex::index<C>());
+            }
+        }
+        template <class C, typename... Args>
+        C* Create(Entity* owner, std::false_type, Args&&... args);
+        //equal values are interned into one instance before the handle component is built
+        template <class C, typename... Args>
+        C* Create(Entity* owner, std::true_type, Args&&... args)
+        {
+            return Create<C>(owner, std::false_type(), MakeShared<typename C::ValueType>(std::forward<Args>(args)...));
+        }
+        template <class C, typename... Args>
+        C* Replace(C* component, std::false_type, Args&&... args);
+        template <class C, typename... Args>
+        C* Replace(C* component, std::true_type, Args&&... args)
+        {
+            //interned first, the old handle may hold the last reference to an equal value
+            return Replace<C>(component, std::false_type(), MakeShared<typename C::ValueType>(std::forward<Args>(args)...));
+        }
     };
 
     template <class C, typename... Args>
-    BaseComponent* ComponentPool::CreateComponent(Args&&... args)
+    C* ComponentPool::Create(Entity* owner, std::false_type, Args&&... args)
+    {
+        if (mode_ == StorageMode::kArchetype)
+        {
+            MarkTransient<C>();
+            return archetypes_.Create<C>(owner, std::forward<Args>(args)...);
+        }
+        return GetAllComponents<C>().Create(owner, std::forward<Args>(args)...);
+    }
+
+    template <class C, typename... Args>
+    C* ComponentPool::Replace(C* component, std::false_type, Args&&... args)
+    {
+        if (mode_ == StorageMode::kArchetype)
+        {
+            return archetypes_.Replace(component, std::forward<Args>(args)...);
+        }
+        return GetAllComponents<C>().Replace(component, std::forward<Args>(args)...);
+    }
+
+    template <class C>
+    ComponentStorage<C>& ComponentPool::RegisterComponent(size_t reserve, MemoryResource* resource)
+    {
+        index_t id = details::ComponentIndex::index<C>();
+        if (id >= component_pools_.size())
+        {
+            component_pools_.resize(id + 1);
+        }
+        if (!component_pools_[id])
+        {
+            component_pools_[id].reset(new ComponentStorage<C>(id));
+            component_pools_[id]->SetClock(&version_);
+            if (IsTransient<C>::value)
+            {
+                transient_types_.set(id);
+                resource = &frame_arena_;
+            }
+        }
+        if (resource && resource != component_pools_[id]->Resource())
+        {
+            component_pools_[id]->SetResource(resource);
+        }
+        if (mode_ == StorageMode::kArchetype)
+        {
+            archetypes_.Register<C>(id);
+        }
+        component_pools_[id]->Reserve(reserve);
+        return *static_cast<ComponentStorage<C>*>(component_pools_[id].get());
+    }
+
+    template <class... Cs>
+    Archetype* ComponentPool::ReserveComponents(size_t count)
+    {
+        if (mode_ == StorageMode::kArchetype)
+        {
+            int transient[] = { 0, (MarkTransient<Cs>(), 0)... };
+            (void)transient;
+            return archetypes_.Prepare<Cs...>(count);
+        }
+        int expand[] = { 0, (RegisterComponent<Cs>(count), 0)... };
+        (void)expand;
+        return nullptr;
+    }
+
+    template <class... Cs>
+    std::tuple<Cs*...> ComponentPool::EmplaceComponents(Archetype* target, Entity* owner)
+    {
+        if (mode_ == StorageMode::kArchetype)
+        {
+            return archetypes_.Emplace<Cs...>(target, owner);
+        }
+        return std::tuple<Cs*...>{ GetAllComponents<Cs>().Emplace(owner)... };
+    }
+
+    template <class T>
+    SharedStorage<T>& ComponentPool::GetSharedValues()
+    {
+        index_t id = details::ComponentIndex::index<Shared<T>>();
+        if (id >= shared_values_.size())
+        {
+            shared_values_.resize(id + 1);
+        }
+        if (!shared_values_[id])
+        {
+            shared_values_[id].reset(new SharedStorage<T>());
+        }
+        return *static_cast<SharedStorage<T>*>(shared_values_[id].get());
+    }
+
+    template <class C>
+    ComponentStorage<C>& ComponentPool::GetAllComponents()
     {
-        ComponentVector& pool = GetAllComponents(details::ComponentIndex::index<C>());
-        BaseComponent* component = new C();
-        (static_cast<C*>(component))->Reset(std::forward<Args>(args)...);
-        pool.push_back(component);
-        return component;
+        BaseComponentStorage* storage = FindComponents(details::ComponentIndex::index<C>());
+        return storage ? *static_cast<ComponentStorage<C>*>(storage) : RegisterComponent<C>();
     }
-}
\ No newline at end of file
+}
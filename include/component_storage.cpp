@@ -0,0 +1,217 @@
+#include "component_storage.h"
+#include "entity.h"
+#include <cstdlib>
+#include <algorithm>
+
+using namespace ecs;
+
+constexpr size_t BaseComponentStorage::kCacheLineSize;
+constexpr size_t BaseComponentStorage::kBlockBytes;
+constexpr size_t BaseComponentStorage::kSparsePageShift;
+constexpr index_t BaseComponentStorage::kInvalidSlot;
+
+void* details::AlignedAlloc(size_t bytes, size_t alignment)
+{
+	void* raw = std::malloc(bytes + alignment + sizeof(void*));
+	if (!raw)
+	{
+		throw std::bad_alloc();
+	}
+	uintptr_t aligned = (reinterpret_cast<uintptr_t>(raw) + sizeof(void*) + alignment - 1) & ~(uintptr_t)(alignment - 1);
+	//the original allocation is stored right before the aligned block
+	reinterpret_cast<void**>(aligned)[-1] = raw;
+	return reinterpret_cast<void*>(aligned);
+}
+
+void details::AlignedFree(void* ptr)
+{
+	if (ptr)
+	{
+		std::free(reinterpret_cast<void**>(ptr)[-1]);
+	}
+}
+
+BaseComponentStorage::BaseComponentStorage(index_t type_index, size_t stride, size_t block_shift, MemoryResource* resource)
+	: type_index_(type_index), stride_(stride), block_shift_(block_shift), resource_(resource)
+{
+}
+
+BaseComponentStorage::~BaseComponentStorage()
+{
+	for (char* block : blocks_)
+	{
+		resource_->Deallocate(block, BlockCapacity() * stride_, kCacheLineSize);
+	}
+	blocks_.clear();
+}
+
+void BaseComponentStorage::ShrinkToFit()
+{
+	while (blocks_.size() > BlockCount())
+	{
+		resource_->Deallocate(blocks_.back(), BlockCapacity() * stride_, kCacheLineSize);
+		blocks_.pop_back();
+		block_versions_.pop_back();
+	}
+}
+
+void BaseComponentStorage::SetResource(MemoryResource* resource)
+{
+	ECS_ASSERT(blocks_.empty(), "Error, cannot change the resource of a storage that holds blocks");
+	resource_ = resource;
+}
+
+void BaseComponentStorage::Reserve(size_t count)
+{
+	AllocateBlocks(size_ + count);
+	owners_.reserve(size_ + count);
+	versions_.reserve(size_ + count);
+}
+
+void BaseComponentStorage::AllocateBlocks(size_t capacity)
+{
+	while (blocks_.size() * BlockCapacity() < capacity)
+	{
+		blocks_.push_back(static_cast<char*>(resource_->Allocate(BlockCapacity() * stride_, kCacheLineSize)));
+		block_versions_.emplace_back(0);
+	}
+}
+
+char* BaseComponentStorage::Push(Entity* owner)
+{
+	AllocateBlocks(size_ + 1);
+	Sparse(owner) = index_t(size_);
+	owners_.push_back(owner);
+	versions_.push_back(0);
+	Stamp(size_, Now());
+	return Address(size_++);
+}
+
+void BaseComponentStorage::Stamp(size_t index, version_t version)
+{
+	versions_[index] = version;
+	std::atomic<version_t>& block = block_versions_[index >> block_shift_];
+	version_t newest = block.load(std::memory_order_relaxed);
+	while (newest < version && !block.compare_exchange_weak(newest, version, std::memory_order_relaxed))
+	{
+	}
+}
+
+void BaseComponentStorage::RemoveMany(const std::vector<Entity*>& owners)
+{
+	//a sweep touches every component, swap-removing touches two per owner
+	if (owners.size() * 4 < size_)
+	{
+		for (Entity* owner : owners)
+		{
+			if (Contains(owner))
+			{
+				Remove(owner);
+			}
+		}
+		return;
+	}
+	for (Entity* owner : owners)
+	{
+		size_t index = IndexOf(owner);
+		if (index != size_)
+		{
+			Destroy(index);
+			Sparse(owner) = kInvalidSlot;
+			owners_[index] = nullptr;
+		}
+	}
+	size_t kept = 0;
+	for (size_t index = 0; index < size_; ++index)
+	{
+		Entity* owner = owners_[index];
+		if (!owner)
+		{
+			continue;
+		}
+		if (index != kept)
+		{
+			owners_[kept] = owner;
+			Sparse(owner) = index_t(kept);
+			Stamp(kept, versions_[index]);
+			owner->RebindComponent(type_index_, Relocate(kept, index));
+		}
+		++kept;
+	}
+	owners_.resize(kept);
+	versions_.resize(kept);
+	size_ = kept;
+}
+
+void BaseComponentStorage::Clear()
+{
+	for (size_t index = 0; index < size_; ++index)
+	{
+		Destroy(index);
+		Sparse(owners_[index]) = kInvalidSlot;
+	}
+	owners_.clear();
+	versions_.clear();
+	size_ = 0;
+}
+
+void BaseComponentStorage::Discard()
+{
+	if (!trivially_destructible_)
+	{
+		for (size_t index = 0; index < size_; ++index)
+		{
+			Destroy(index);
+		}
+	}
+	owners_.clear();
+	versions_.clear();
+	size_ = 0;
+	ShrinkToFit();
+}
+
+size_t BaseComponentStorage::IndexOf(const Entity* owner) const
+{
+	index_t entity_index = EntityIndex(owner->GetEntityID());
+	size_t page = entity_index >> kSparsePageShift;
+	if (page >= sparse_.size() || !sparse_[page])
+	{
+		return size_;
+	}
+	index_t slot = sparse_[page][entity_index & ((index_t(1) << kSparsePageShift) - 1)];
+	return (slot < size_ && owners_[slot] == owner) ? slot : size_;
+}
+
+index_t& BaseComponentStorage::Sparse(const Entity* owner)
+{
+	index_t entity_index = EntityIndex(owner->GetEntityID());
+	size_t page = entity_index >> kSparsePageShift;
+	if (page >= sparse_.size())
+	{
+		sparse_.resize(page + 1);
+	}
+	if (!sparse_[page])
+	{
+		const size_t page_size = size_t(1) << kSparsePageShift;
+		sparse_[page].reset(new index_t[page_size]);
+		std::fill(sparse_[page].get(), sparse_[page].get() + page_size, kInvalidSlot);
+	}
+	return sparse_[page][entity_index & ((index_t(1) << kSparsePageShift) - 1)];
+}
+
+void BaseComponentStorage::Pop(size_t index, void* moved)
+{
+	size_t last = size_ - 1;
+	Sparse(owners_[index]) = kInvalidSlot;
+	if (index != last)
+	{
+		//the component moved into index belongs to another entity now, tell it about the new address
+		owners_[index] = owners_[last];
+		Sparse(owners_[index]) = index_t(index);
+		Stamp(index, versions_[last]);
+		owners_[index]->RebindComponent(type_index_, moved);
+	}
+	owners_.pop_back();
+	versions_.pop_back();
+	--size_;
+}
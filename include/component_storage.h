@@ -0,0 +1,208 @@
+#pragma once
+
+#include <new>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <vector>
+#include <utility>
+#include "ecs_define.h"
+#include "base_component.h"
+#include "memory_resource.h"
+
+namespace ecs
+{
+	class Entity;
+
+	namespace details
+	{
+		//largest power of two count of elements that fits into one block, at least one
+		constexpr size_t BlockCapacity(size_t element_size, size_t block_bytes)
+		{
+			size_t capacity = 1;
+			while (capacity * 2 * element_size <= block_bytes)
+			{
+				capacity *= 2;
+			}
+			return capacity;
+		}
+
+		//cache-line aligned raw memory for blocks and chunks
+		void* AlignedAlloc(size_t bytes, size_t alignment);
+		void AlignedFree(void* ptr);
+
+		constexpr size_t Log2(size_t value)
+		{
+			size_t shift = 0;
+			while ((size_t(1) << shift) < value)
+			{
+				++shift;
+			}
+			return shift;
+		}
+	}
+
+	//components of one type are stored by value in cache-line aligned blocks.
+	//live components are kept packed in [0, size), blocks are never reallocated,
+	//so growing the storage does not move existing components.
+	//a paged sparse array maps entity indices to dense slots, so add, remove and lookup are O(1).
+	class BaseComponentStorage
+	{
+	public:
+		static constexpr size_t kCacheLineSize = 64;
+		static constexpr size_t kBlockBytes = 16 * 1024;
+		static constexpr size_t kSparsePageShift = 12;
+		static constexpr index_t kInvalidSlot = index_t(-1);
+
+	protected:
+		index_t type_index_;
+		size_t stride_;
+		size_t block_shift_;
+		size_t size_{ 0 };
+		std::vector<char*> blocks_;
+		MemoryResource* resource_;
+		std::vector<Entity*> owners_;
+		std::vector<std::unique_ptr<index_t[]>> sparse_;
+		bool trivially_destructible_{ false };
+		//version of the last write by dense slot, and the newest of them by block.
+		//block versions are atomic as parallel loops touch different slots of one block
+		const std::atomic<version_t>* clock_{ nullptr };
+		std::vector<version_t> versions_;
+		std::deque<std::atomic<version_t>> block_versions_;
+
+	public:
+		BaseComponentStorage(index_t type_index, size_t stride, size_t block_shift, MemoryResource* resource);
+		virtual ~BaseComponentStorage();
+		BaseComponentStorage(const BaseComponentStorage&) = delete;
+		BaseComponentStorage& operator=(const BaseComponentStorage&) = delete;
+
+		index_t TypeIndex() const { return type_index_; }
+		size_t size() const { return size_; }
+		bool empty() const { return size_ == 0; }
+		Entity* Owner(size_t index) const { return owners_[index]; }
+		//dense slot of the component owned by owner, size() if it has none
+		size_t IndexOf(const Entity* owner) const;
+		bool Contains(const Entity* owner) const { return IndexOf(owner) != size_; }
+		//allocates blocks up front so that the next count components do not allocate
+		void Reserve(size_t count);
+		//gives the blocks no component lives in back to the resource
+		void ShrinkToFit();
+		MemoryResource* Resource() const { return resource_; }
+		//only before the first block was allocated
+		void SetResource(MemoryResource* resource);
+
+		//blocks in use, the last one may be partially filled
+		size_t BlockCount() const { return (size_ + BlockCapacity() - 1) >> block_shift_; }
+		size_t BlockCapacity() const { return size_t(1) << block_shift_; }
+		size_t BlockSize(size_t block) const
+		{
+			size_t first = block << block_shift_;
+			return size_ - first < BlockCapacity() ? size_ - first : BlockCapacity();
+		}
+		char* Block(size_t block) const { return blocks_[block]; }
+		Entity* const* BlockOwners(size_t block) const { return owners_.data() + (block << block_shift_); }
+
+		void SetClock(const std::atomic<version_t>* clock) { clock_ = clock; }
+		version_t Now() const { return clock_ ? clock_->load(std::memory_order_relaxed) : 0; }
+		version_t Version(size_t index) const { return versions_[index]; }
+		version_t BlockVersion(size_t block) const { return block_versions_[block].load(std::memory_order_relaxed); }
+		const version_t* BlockVersions(size_t block) const { return versions_.data() + (block << block_shift_); }
+		//records a write to the component at index
+		void Touch(size_t index) { Stamp(index, Now()); }
+
+		virtual void Remove(const Entity* owner) = 0;
+		//removes the components of owners with one sweep that keeps the order of the others,
+		//or one by one when they are few compared to the size. Owners without one are ignored.
+		void RemoveMany(const std::vector<Entity*>& owners);
+		//destroys every component, the owners still point at them and must drop their slots
+		void Clear();
+		//like Clear, but also gives every block back and skips the destructors of trivially destructible
+		//types. The sparse array is left stale, lookups check the owner anyway. Meant for arena blocks.
+		void Discard();
+
+	protected:
+		virtual void Destroy(size_t index) = 0;
+		//moves the component at from into the empty slot to, returns it
+		virtual void* Relocate(size_t to, size_t from) = 0;
+		char* Address(size_t index) const
+		{
+			return blocks_[index >> block_shift_] + (index & (BlockCapacity() - 1)) * stride_;
+		}
+		//returns the address of a new slot at the end, allocating a block if needed
+		char* Push(Entity* owner);
+		//drops the last slot after its component was moved into index, or destroyed if index is the last one
+		void Pop(size_t index, void* moved);
+		void Stamp(size_t index, version_t version);
+	private:
+		void AllocateBlocks(size_t capacity);
+		index_t& Sparse(const Entity* owner);
+	};
+
+	//C is a BaseComponent or a plain struct, the owner of every slot is kept in owners_ either way
+	template <class C>
+	class ComponentStorage : public BaseComponentStorage
+	{
+	public:
+		static constexpr size_t kBlockCapacity = details::BlockCapacity(sizeof(C), kBlockBytes);
+		static_assert(alignof(C) <= kCacheLineSize, "over-aligned components are not supported");
+
+		ComponentStorage(index_t type_index, MemoryResource* resource = ComponentResource<C>::Get())
+			: BaseComponentStorage(type_index, sizeof(C), details::Log2(kBlockCapacity), resource)
+		{
+			trivially_destructible_ = std::is_trivially_destructible<C>::value;
+		}
+		~ComponentStorage() override
+		{
+			for (size_t i = 0; i < size_; ++i)
+			{
+				At(i)->~C();
+			}
+		}
+
+		C* At(size_t index) const { return reinterpret_cast<C*>(Address(index)); }
+		C* Find(const Entity* owner) const
+		{
+			size_t index = IndexOf(owner);
+			return index != size_ ? At(index) : nullptr;
+		}
+
+		template <typename... Args>
+		C* Create(Entity* owner, Args&&... args)
+		{
+			return details::ConstructComponent<C>(Push(owner), std::forward<Args>(args)...);
+		}
+		//value initialized, Reset is not called
+		C* Emplace(Entity* owner) { return new (Push(owner)) C(); }
+
+		//destroys the component and constructs a new one in the same slot
+		template <typename... Args>
+		C* Replace(C* component, Args&&... args)
+		{
+			component->~C();
+			return details::ConstructComponent<C>(component, std::forward<Args>(args)...);
+		}
+
+		//the last component is moved into the freed slot
+		void Remove(const Entity* owner) override
+		{
+			size_t index = IndexOf(owner);
+			ECS_ASSERT(index < size_, "Error, entity has no component in this storage");
+			size_t last = size_ - 1;
+			C* removed = At(index);
+			removed->~C();
+			if (index != last)
+			{
+				details::RelocateComponent(removed, At(last));
+			}
+			Pop(index, removed);
+		}
+
+	protected:
+		void Destroy(size_t index) override { At(index)->~C(); }
+		void* Relocate(size_t to, size_t from) override
+		{
+			details::RelocateComponent(At(to), At(from));
+			return At(to);
+		}
+	};
+}
@@ -1,17 +1,64 @@
 #pragma once
 
 #include <cstdint>
+#include <cstddef>
+#include <stdexcept>
 #include <vector>
+#include <bitset>
 #include <type_traits>
 #include <cassert>
 
 namespace ecs
 {
 
-	using EntityID = uint32_t;
 	using index_t = uint32_t;
 	using ComponentIndexList = std::vector<index_t>;
 
+	//an entity id packs the slot index in the low bits and the slot generation in the high bits,
+	//define ECS_64BIT_ENTITY_ID for 32 bit indices and generations.
+	//The generation wraps, a stale id resolves again once its slot went through all generations.
+	//Slots are reused in release order and only while ECS_MIN_FREE_ENTITY_SLOTS are free, so with
+	//32 bit ids that takes at least 1023 * ECS_MIN_FREE_ENTITY_SLOTS destructions.
+#ifdef ECS_64BIT_ENTITY_ID
+	using EntityID = uint64_t;
+	constexpr unsigned kEntityIndexBits = 32;
+#else
+	using EntityID = uint32_t;
+	constexpr unsigned kEntityIndexBits = 22;
+#endif
+	constexpr unsigned kEntityGenerationBits = sizeof(EntityID) * 8 - kEntityIndexBits;
+	constexpr EntityID kEntityIndexMask = (EntityID(1) << kEntityIndexBits) - 1;
+	constexpr EntityID kEntityGenerationMask = (EntityID(1) << kEntityGenerationBits) - 1;
+	constexpr EntityID kInvalidEntityID = 0;
+
+#ifndef ECS_MIN_FREE_ENTITY_SLOTS
+#define ECS_MIN_FREE_ENTITY_SLOTS 1024
+#endif
+
+	inline index_t EntityIndex(EntityID eid) { return index_t(eid & kEntityIndexMask); }
+	inline EntityID EntityGeneration(EntityID eid) { return (eid >> kEntityIndexBits) & kEntityGenerationMask; }
+	inline EntityID MakeEntityID(index_t index, EntityID generation) { return (generation << kEntityIndexBits) | EntityID(index); }
+
+	//change versions come from one clock per admin, a component records the version of its last write
+	using version_t = uint32_t;
+
+#ifndef ECS_MAX_COMPONENTS
+#define ECS_MAX_COMPONENTS 64
+#endif
+	using ComponentMask = std::bitset<ECS_MAX_COMPONENTS>;
+
+	enum class StorageMode
+	{
+		kComponent,	//one packed storage per component type
+		kArchetype,	//entities with the same component set share chunks
+	};
+
+	enum class ScheduleMode
+	{
+		kSequential,	//systems run one after another in registration order
+		kParallel,	//systems that do not conflict run at the same time on a worker pool
+	};
+
 #define ECS_ASSERT(Expr, Msg) if(!(Expr)) throw std::runtime_error(Msg);
 
 #ifndef ECS_ASSERT
@@ -25,9 +72,9 @@ static_assert(details::is_callable<T>::value, "Provide a function or lambda expr
 
 #define ECS_ASSERT_IS_ENTITY(T) static_assert(std::is_same<class Entity, T>::value, #T " is not entity");
 
-#define ECS_ASSERT_IS_COMPONENT(T)                                                                      \
-    static_assert((std::is_base_of<BaseComponent, T>::value && !std::is_same<BaseComponent, T>::value), \
-                  "Class type must be derived from BaseComponent");
+#define ECS_ASSERT_IS_COMPONENT(T)                                                  \
+    static_assert((std::is_class<T>::value && !std::is_same<BaseComponent, T>::value), \
+                  #T " must be a class type other than BaseComponent");
 
 #define ECS_ASSERT_IS_SYSTEM(T)                                                                   \
     static_assert((std::is_base_of<BaseSystem, T>::value && !std::is_same<BaseSystem, T>::value), \
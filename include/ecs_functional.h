@@ -25,7 +25,7 @@ namespace ecs
 
 		template <typename F, typename Tuple, bool Done, size_t Total, size_t... N>
 		struct apply_impl {
-			static bool call(F f, Tuple&& t)
+			static bool call(F& f, Tuple&& t)
 			{
 				return apply_impl<F, Tuple, Total == 1 + sizeof...(N), Total, N..., sizeof...(N)>::call(
 					f, std::forward<Tuple>(t));
@@ -34,15 +34,15 @@ namespace ecs
 
 		template <typename F, typename Tuple, size_t Total, size_t... N>
 		struct apply_impl<F, Tuple, true, Total, N...> {
-			static bool call(F f, Tuple&& t) { return f(std::get<N>(std::forward<Tuple>(t))...); }
+			static bool call(F& f, Tuple&& t) { return f(std::get<N>(std::forward<Tuple>(t))...); }
 		};
 
-		// user invokes this
+		// user invokes this, the callable is passed through by reference
 		template <typename F, typename Tuple>
-		bool apply(F f, Tuple&& t)
+		bool apply(F&& f, Tuple&& t)
 		{
 			typedef typename std::decay<Tuple>::type ttype;
-			return details::apply_impl<F, Tuple, 0 == std::tuple_size<ttype>::value, std::tuple_size<ttype>::value>::call(
+			return details::apply_impl<std::remove_reference_t<F>, Tuple, 0 == std::tuple_size<ttype>::value, std::tuple_size<ttype>::value>::call(
 				f, std::forward<Tuple>(t));
 		}
 
@@ -119,19 +119,54 @@ namespace ecs
             }
         };
 
+        struct QueryIndex {
+            template <typename Q>
+            static index_t index()
+            {
+                static index_t idx = count()++;
+                return idx;
+            }
+            static index_t& count()
+            {
+                static index_t counter = 0;
+                return counter;
+            }
+        };
+
 		struct ComponentIndex {
 			template <typename C>
 			static index_t index()
 			{
 				//ECS_ASSERT_IS_COMPONENT(C);
-				static index_t idx = count()++;
+				static index_t idx = next();
 				return idx;
 			}
+			//component indices address the bits of a ComponentMask
+			static index_t next()
+			{
+				ECS_ASSERT(count() < ECS_MAX_COMPONENTS, "Too many component types, raise ECS_MAX_COMPONENTS");
+				return count()++;
+			}
 			static index_t& count()
 			{
 				static index_t counter = 0;
 				return counter;
 			}
 		};
+
+		template <typename... Cs>
+		const ComponentMask& ComponentMaskOf()
+		{
+			static const ComponentMask mask = [] {
+				ComponentMask m;
+				index_t ids[] = { ComponentIndex::index<Cs>()... };
+				for (index_t id : ids)
+				{
+					m.set(id);
+				}
+				return m;
+			}();
+			return mask;
+		}
     }
 }
\ No newline at end of file
@@ -3,39 +3,51 @@
 #include <functional>
 #include <tuple>
 #include "ecs_functional.h"
+#include "query_terms.h"
 #include "entity_admin.h"
 namespace ecs
 {
+	//predicate of an unfiltered query, the filter test folds away at compile time
+	struct NoFilter
+	{
+		template<typename... Ts>
+		constexpr bool operator()(Ts*...) const { return true; }
+	};
 
-	template<typename T>
-	struct IsComponent : std::integral_constant<bool, std::is_base_of<BaseComponent, T>::value && !std::is_same<BaseComponent, T>::value> {};
-	template<typename T>
-	constexpr bool IsComponent_v = IsComponent<T>::value;
-
-	template<typename T>
-	struct IsComponentPointer : std::integral_constant<bool, IsComponent_v<std::remove_pointer<T>> && !std::is_pointer<T>::value> {};
-	template<typename T>
-	constexpr bool IsComponentPointer_v = IsComponentPointer<T>::value;
+	namespace details
+	{
+		template<typename Pr, typename Tuple>
+		bool test_filter(const Pr& pred, Tuple&& t) { return details::apply(pred, std::forward<Tuple>(t)); }
+		template<typename R, typename... Ts, typename Tuple>
+		bool test_filter(const std::function<R(Ts...)>& pred, Tuple&& t) { return !pred || details::apply(pred, std::forward<Tuple>(t)); }
+		template<typename Tuple>
+		constexpr bool test_filter(const NoFilter&, Tuple&&) { return true; }
+	}
 
-	template <typename... Args>
-	class ComponentItr
+	//iterates the entities that match Args and pass Pr. The predicate type is a
+	//template parameter so lambdas inline into the loop, see MakeComponentItr.
+	//Args are component types or Exclude<...> / Optional<...> / Changed<...> / Mut<...> terms, at least one
+	//non-tag component is required. tag terms yield nothing, they only narrow the match.
+	//Changed terms skip whole blocks and chunks that were not written since the last run of the current system.
+	template <typename Pr, typename... Args>
+	class BasicComponentItr
 	{
-		static_assert(details::conjunction_v<IsComponent<Args>... > && (sizeof...(Args) > 0), "invalid argument type!");
+		static_assert(details::conjunction_v<std::integral_constant<bool, details::QueryTerm<Args>::kValid>...> && (details::RequiredCount<Args...>() > 0), "invalid argument type!");
 	private:
 		class ItemIterator;
 		using Iterator = ItemIterator;
-		using TagDispatchType = std::conditional_t<(sizeof...(Args) == 1), std::true_type, std::false_type>;
-		using Pr = typename std::function<bool(std::add_pointer_t<Args>...)>;
+		using Yield = details::QueryYield<Args...>;
+		using TagDispatchType = std::conditional_t<(std::tuple_size<Yield>::value == 1), std::true_type, std::false_type>;
 
 		EntityAdmin* admin_;
 		Pr pred_;
 
 	public:
-		ComponentItr(EntityAdmin* admin)
-			: admin_(admin)
+		BasicComponentItr(EntityAdmin* admin)
+			: admin_(admin), pred_()
 		{
 		}
-		ComponentItr(EntityAdmin* admin, Pr&& pred)
+		BasicComponentItr(EntityAdmin* admin, Pr&& pred)
 			: admin_(admin), pred_(std::move(pred))
 		{
 		}
@@ -50,89 +62,324 @@ namespace ecs
 		class ItemIterator
 		{
 		private:
-			Pr pred_;
-			ComponentVector& component_vector_;
-			ComponentVector::const_iterator it_;
-			ComponentVector::const_iterator end_;
+			const Pr* pred_;
+			EntityAdmin* admin_{ nullptr };
+			version_t since_{ 0 };
+			//component mode walks the blocks of the smallest required storage,
+			//archetype mode walks the chunks of every archetype that matches the masks
+			BaseComponentStorage* storage_{ nullptr };
+			const ArchetypeList* archetypes_{ nullptr };
+			const details::QueryMasks<Args...>* masks_;
+			size_t archetype_{ 0 };
+			size_t chunk_{ 0 };
+			size_t row_{ 0 };
+			size_t count_{ 0 };
+			Entity* const* owners_{ nullptr };
+			//by term, null for optional terms the archetype lacks and for Exclude terms
+			char* columns_[sizeof...(Args)];
+			//by term, the archetype column and the row versions of the chunk when the chunk holds them
+			int column_index_[sizeof...(Args)];
+			const version_t* versions_[sizeof...(Args)];
+			//every required column of the current chunk is known, no need to go through the owner
+			bool direct_{ false };
+			//component mode tests excluded and tag bits against the owner signature, archetype mode
+			//skips whole archetypes instead and only tests tag bits, which archetypes do not hold
+			bool check_signature_{ false };
 		public:
-			ItemIterator(EntityAdmin* admin, Pr& pred, bool is_begin = true)
-				: pred_(pred)
-				, component_vector_(GetLeastComponentVector<Args...>(admin))
+			ItemIterator(EntityAdmin* admin, const Pr& pred, bool is_begin = true)
+				: pred_(&pred), masks_(&details::QueryMasks<Args...>::Get())
 			{
-				end_ = component_vector_.end();
-				if (is_begin) {
-					it_ = component_vector_.begin();
+				if (!is_begin)
+				{
+					return;
+				}
+				admin_ = admin;
+				since_ = admin->ChangeSince();
+				if (admin->Mode() == StorageMode::kArchetype)
+				{
+					archetypes_ = &admin->GetArchetypes();
+					check_signature_ = masks_->tags.any();
 				}
 				else
 				{
-					it_ = end_;
+					storage_ = GetLeastComponentStorage(admin);
+					direct_ = (details::RequiredCount<Args...>() == 1);
+					check_signature_ = masks_->excluded.any() || masks_->tags.any();
 				}
-				find_next(TagDispatchType());
+				load_chunk();
+				find_next();
 			}
 
-			bool operator!=(const ItemIterator& rhs) const { return It() != rhs.It(); }
-			ComponentVector::const_iterator It() const
-			{
-				return it_;
-			}
+			bool operator!=(const ItemIterator& rhs) const { return owners_ != rhs.owners_ || row_ != rhs.row_; }
 
 			decltype(auto) operator*()
 			{
-				auto ent = (*it_)->Owner();
-				assert(ent);
-				return ent->Get<Args...>();
+				touch_columns(std::index_sequence_for<Args...>());
+				return get(TagDispatchType());
 			}
 			ItemIterator& operator++()
 			{
-				++it_;
-				find_next(TagDispatchType());
+				++row_;
+				find_next();
 				return *this;
 			}
 
 		private:
-			template<typename U>
-			ComponentVector& GetLeastComponentVector(EntityAdmin* admin, ComponentVector& compare_vector)
+			//the smallest required storage, null when one of them was never registered so nothing can match
+			static BaseComponentStorage* GetLeastComponentStorage(EntityAdmin* admin)
 			{
-				auto& component_vector = admin->GetAllComponents(details::ComponentIndex::index<U>());
-				return compare_vector.size() <= component_vector.size() ? compare_vector : component_vector;
+				const index_t ids[] = { details::QueryTerm<Args>::Index()... };
+				const bool required[] = { details::QueryTerm<Args>::kRequired... };
+				BaseComponentStorage* least = nullptr;
+				for (size_t i = 0; i < sizeof...(Args); ++i)
+				{
+					if (!required[i])
+					{
+						continue;
+					}
+					BaseComponentStorage* storage = admin->FindComponents(ids[i]);
+					if (!storage)
+					{
+						return nullptr;
+					}
+					if (!least || storage->size() < least->size())
+					{
+						least = storage;
+					}
+				}
+				return least;
+			}
+		private:
+			//points the iterator at the first row of chunk_, or at the end when there is none left
+			void load_chunk()
+			{
+				row_ = 0;
+				if (storage_ && chunk_ < storage_->BlockCount())
+				{
+					count_ = storage_->BlockSize(chunk_);
+					owners_ = storage_->BlockOwners(chunk_);
+					//only read when direct_, then the single required term owns this storage
+					const bool required[] = { details::QueryTerm<Args>::kRequired... };
+					const bool changed[] = { details::QueryTerm<Args>::kChanged... };
+					const index_t ids[] = { details::QueryTerm<Args>::Index()... };
+					for (size_t i = 0; i < sizeof...(Args); ++i)
+					{
+						columns_[i] = required[i] ? storage_->Block(chunk_) : nullptr;
+						const bool own = changed[i] && ids[i] == storage_->TypeIndex();
+						versions_[i] = own ? storage_->BlockVersions(chunk_) : nullptr;
+						//nothing in the block was written since, skip it whole
+						if (own && storage_->BlockVersion(chunk_) <= since_)
+						{
+							row_ = count_;
+						}
+					}
+					return;
+				}
+				for (; archetypes_ && archetype_ < archetypes_->size(); ++archetype_, chunk_ = 0)
+				{
+					const Archetype& archetype = *(*archetypes_)[archetype_];
+					if (!masks_->MatchesColumns(archetype.Mask()) || chunk_ >= archetype.ChunkCount())
+					{
+						continue;
+					}
+					const index_t ids[] = { details::QueryTerm<Args>::Index()... };
+					const bool changed[] = { details::QueryTerm<Args>::kChanged... };
+					count_ = archetype.ChunkSize(chunk_);
+					owners_ = archetype.ChunkOwners(chunk_);
+					direct_ = true;
+					for (size_t i = 0; i < sizeof...(Args); ++i)
+					{
+						int column = ids[i] != index_t(-1) ? archetype.ColumnOf(ids[i]) : -1;
+						columns_[i] = column >= 0 ? archetype.ChunkColumn(chunk_, column) : nullptr;
+						column_index_[i] = column;
+						versions_[i] = changed[i] ? archetype.ChunkVersions(chunk_, column) : nullptr;
+						if (changed[i] && archetype.ChunkVersion(chunk_, column) <= since_)
+						{
+							row_ = count_;
+						}
+					}
+					return;
+				}
+				count_ = 0;
+				owners_ = nullptr;
 			}
 
-			template<typename U, typename... Us>
-			auto GetLeastComponentVector(EntityAdmin* admin, ComponentVector& compare_vector) -> std::enable_if_t<(sizeof...(Us) != 0), ComponentVector& >
+			template<size_t I, typename T>
+			typename details::QueryTerm<T>::Yield get_column(details::QueryTerm<T>) const
 			{
-				auto& component_vector = admin->GetAllComponents(details::ComponentIndex::index<U>());
-				return GetLeastComponentVector<Us...>(admin, compare_vector.size() <= component_vector.size() ? compare_vector : component_vector);
+				return get_component<I, T>(IsTag<T>());
 			}
-			template<typename U>
-			ComponentVector& GetLeastComponentVector(EntityAdmin* admin)
+			template<size_t I, typename T>
+			std::tuple<T*> get_component(std::false_type) const
 			{
-				return admin->GetAllComponents(details::ComponentIndex::index<U>());
+				return std::tuple<T*>(reinterpret_cast<T*>(columns_[I]) + row_);
 			}
-			template<typename U, typename... Us>
-			std::enable_if_t<sizeof...(Us) != 0, ComponentVector&> GetLeastComponentVector(EntityAdmin* admin)
+			template<size_t I, typename T>
+			std::tuple<> get_component(std::true_type) const
 			{
-				auto& component_vector = admin->GetAllComponents(details::ComponentIndex::index<U>());
-				return GetLeastComponentVector<Us...>(admin, component_vector);
+				return std::tuple<>();
 			}
-		private:
-			void find_next(std::false_type&& t) {
-				while (it_ != end_)
+			template<size_t I, typename T>
+			std::tuple<T*> get_column(details::QueryTerm<Optional<T>>) const
+			{
+				if (!archetypes_ || IsTag<T>::value)
+				{
+					return details::FetchTerm(owners_[row_], details::QueryTerm<Optional<T>>());
+				}
+				return std::tuple<T*>(columns_[I] ? reinterpret_cast<T*>(columns_[I]) + row_ : nullptr);
+			}
+			template<size_t I, typename... Ts>
+			std::tuple<> get_column(details::QueryTerm<Exclude<Ts...>>) const
+			{
+				return std::tuple<>();
+			}
+			template<size_t I, typename T>
+			std::tuple<T*> get_column(details::QueryTerm<Changed<T>>) const
+			{
+				return get_component<I, T>(std::false_type());
+			}
+			template<size_t I, typename T>
+			std::tuple<T*> get_column(details::QueryTerm<Mut<T>>) const
+			{
+				return get_component<I, T>(std::false_type());
+			}
+
+			//records the writes of the Mut terms for the row handed out
+			template<size_t I, typename T>
+			void touch_column(details::QueryTerm<T>) const {}
+			template<size_t I, typename T>
+			void touch_column(details::QueryTerm<Mut<T>>) const
+			{
+				if (archetypes_)
+				{
+					Archetype& archetype = *(*archetypes_)[archetype_];
+					archetype.Touch(chunk_ * archetype.ChunkCapacity() + row_, column_index_[I]);
+				}
+				else if (storage_->TypeIndex() == details::ComponentIndex::index<T>())
+				{
+					storage_->Touch(chunk_ * storage_->BlockCapacity() + row_);
+				}
+				else
+				{
+					owners_[row_]->template Modify<T>();
+				}
+			}
+			template<size_t... I>
+			void touch_columns(std::index_sequence<I...>) const
+			{
+				int expand[] = { 0, (touch_column<I>(details::QueryTerm<Args>()), 0)... };
+				(void)expand;
+			}
+
+			//the version of the last write to the component of a Changed term in the current row
+			version_t version_of(size_t term, index_t id) const
+			{
+				return versions_[term] ? versions_[term][row_] : admin_->VersionOf(owners_[row_], id);
+			}
+			bool changed() const
+			{
+				const bool changed[] = { false, details::QueryTerm<Args>::kChanged... };
+				const index_t ids[] = { 0, details::QueryTerm<Args>::Index()... };
+				for (size_t i = 0; i < sizeof...(Args); ++i)
 				{
-					auto ent = (*it_)->Owner();
-					if (ent && ent->Has<Args...>() && (!pred_ || (pred_ && details::apply(pred_, ent->Get<Args...>()))))
+					if (changed[i + 1] && version_of(i, ids[i + 1]) <= since_)
 					{
-						break;
+						return false;
 					}
-					++it_;
 				}
+				return true;
+			}
+
+			template<size_t... I>
+			Yield get_columns(std::index_sequence<I...>) const
+			{
+				return std::tuple_cat(get_column<I>(details::QueryTerm<Args>())...);
+			}
+
+			Yield get_tuple() const
+			{
+				if (direct_)
+				{
+					return get_columns(std::index_sequence_for<Args...>());
+				}
+				Entity* ent = owners_[row_];
+				assert(ent);
+				return details::FetchTerms<Args...>(ent);
+			}
+
+			std::tuple_element_t<0, Yield> get(std::true_type&&) const
+			{
+				return std::get<0>(get_tuple());
+			}
+
+			Yield get(std::false_type&&) const
+			{
+				return get_tuple();
+			}
+
+			//the signature is tested before any component pointer is looked up
+			bool match() const
+			{
+				if ((!direct_ || check_signature_) && !masks_->Matches(owners_[row_]->Signature()))
+				{
+					return false;
+				}
+				if (details::ChangedCount<Args...>() > 0 && !changed())
+				{
+					return false;
+				}
+				return details::test_filter(*pred_, get_tuple());
 			}
 
-			void find_next(std::true_type&& t) {
-				while (it_ != end_ && pred_ && !pred_((*it_)->Owner()->Get<Args...>()))
+			void find_next()
+			{
+				while (owners_)
 				{
-					++it_;
+					if (row_ == count_)
+					{
+						++chunk_;
+						load_chunk();
+					}
+					else if (match())
+					{
+						break;
+					}
+					else
+					{
+						++row_;
+					}
 				}
 			}
 		};
 	};
+
+	//the original query form, the predicate is optional and type erased
+	template <typename... Args>
+	class ComponentItr : public BasicComponentItr<typename details::QueryFilter<details::QueryYield<Args...>>::type, Args...>
+	{
+		using Pr = typename details::QueryFilter<details::QueryYield<Args...>>::type;
+	public:
+		ComponentItr(EntityAdmin* admin)
+			: BasicComponentItr<Pr, Args...>(admin)
+		{
+		}
+		ComponentItr(EntityAdmin* admin, Pr&& pred)
+			: BasicComponentItr<Pr, Args...>(admin, std::move(pred))
+		{
+		}
+	};
+
+	//for (PositionComponent* p : MakeComponentItr<PositionComponent>(admin)) is a plain linear scan
+	template <typename... Args>
+	BasicComponentItr<NoFilter, Args...> MakeComponentItr(EntityAdmin* admin)
+	{
+		return BasicComponentItr<NoFilter, Args...>(admin);
+	}
+
+	//the lambda is stored by value and called directly in the loop
+	template <typename... Args, typename Pr>
+	BasicComponentItr<std::decay_t<Pr>, Args...> MakeComponentItr(EntityAdmin* admin, Pr&& pred)
+	{
+		return BasicComponentItr<std::decay_t<Pr>, Args...>(admin, std::decay_t<Pr>(std::forward<Pr>(pred)));
+	}
 }
\ No newline at end of file
@@ -11,80 +11,144 @@ Entity::~Entity()
 	DestroyAllComponent();
 }
 
-Entity& Entity::AddComponent(const index_t index, BaseComponent* component) 
+Entity& Entity::AddComponent(const index_t index, void* component) 
 {
 	ECS_ASSERT(!HasComponent(index), "Error, cannot add component to entity, component already exists");
-	components_[index] = component;
-	component->SetOwner(this);
+	//tags come without a component and leave the slots alone
+	if (component)
+	{
+		if (index >= slots_.size())
+		{
+			slots_.resize(index + 1, nullptr);
+		}
+		slots_[index] = component;
+	}
+	signature_.set(index);
+	pool_.OnSignatureChanged(this, index);
 	return *this;
 }
 
 Entity& Entity::RemoveComponent(const index_t index) 
 {
 	ECS_ASSERT(HasComponent(index), "Error, cannot remove component to entity, component not exists");
+	NotifyRemove(index);
+	if (!GetComponent(index))
+	{
+		Detach(index);
+		return *this;
+	}
 	ReplaceWith(index, nullptr);
 	return *this;
 }
 
-Entity& Entity::ReplaceComponent(const index_t index, BaseComponent* component) 
+void Entity::Destroy() {}
+
+void Entity::ReplaceWith(const index_t index, void* replacement)
 {
-	if (HasComponent(index))
+	void* prev_component = GetComponent(index);
+	if (prev_component == replacement)
 	{
-		ReplaceWith(index, component);
 	}
-	else if (component != nullptr)
+	else
 	{
-		AddComponent(index, component);
+		pool_.RemoveComponent(this, index, prev_component);
+		slots_[index] = replacement;
+		if (replacement == nullptr)
+		{
+			signature_.reset(index);
+			pool_.OnSignatureChanged(this, index);
+		}
 	}
-
-	return *this;
 }
 
-BaseComponent* Entity::GetComponent(const index_t index) const
+void Entity::RebindComponent(const index_t index, void* component)
 {
-	if (!HasComponent(index))
+	if (HasComponent(index))
 	{
-		return nullptr;
+		slots_[index] = component;
 	}
-
-	return components_.at(index);
 }
 
-bool Entity::HasComponent(const index_t index) const 
-{ 
-	return (components_.find(index) != components_.end());
+void Entity::NotifyRemove(const index_t index)
+{
+	if (!HasComponent(index) || removing_.test(index) || !pool_.Observes(ComponentEvent::kRemove, index))
+	{
+		return;
+	}
+	removing_.set(index);
+	pool_.Notify(ComponentEvent::kRemove, this, index, GetComponent(index));
+	removing_.reset(index);
 }
 
-void Entity::Destroy() {}
+void Entity::NotifyRemoveAll()
+{
+	ComponentMask signature = signature_;
+	for (index_t index = 0; signature.any(); ++index)
+	{
+		if (signature.test(index))
+		{
+			signature.reset(index);
+			NotifyRemove(index);
+		}
+	}
+}
 
-void Entity::ReplaceWith(const index_t index, BaseComponent * replacement)
+void Entity::DestroyAllComponent()
 {
-	BaseComponent* prev_component = GetComponent(index);
-	if (prev_component == replacement)
+	NotifyRemoveAll();
+	//destroyed by an observer of a removal, the components being removed are left to that removal
+	if (removing_.any())
+	{
+		ComponentMask rest = signature_ & ~removing_;
+		for (index_t index = 0; rest.any(); ++index)
+		{
+			if (rest.test(index))
+			{
+				rest.reset(index);
+				pool_.RemoveComponent(this, index, GetComponent(index));
+				Detach(index);
+			}
+		}
+		return;
+	}
+	if (pool_.Mode() == StorageMode::kArchetype)
 	{
+		pool_.RemoveAllComponents(this);
 	}
 	else
 	{
-		//onRemove
-		pool_.RemoveComponent(index, prev_component);
-		if (replacement == nullptr)
+		for (index_t index = 0; index < slots_.size(); ++index)
 		{
-			components_.erase(index);
+			pool_.RemoveComponent(this, index, slots_[index]);
 		}
-		else
+	}
+	DetachAll();
+}
+
+void Entity::Detach(const index_t index)
+{
+	if (HasComponent(index))
+	{
+		if (index < slots_.size())
 		{
-			components_[index] = replacement;
-			components_[index]->SetOwner(this);
+			slots_[index] = nullptr;
 		}
+		signature_.reset(index);
+		pool_.OnSignatureChanged(this, index);
 	}
 }
 
-void Entity::DestroyAllComponent()
+void Entity::DetachAll()
 {
-	for (const auto& kv : components_)
+	ComponentMask removed = signature_;
+	slots_.clear();
+	signature_.reset();
+	for (index_t index = 0; removed.any(); ++index)
 	{
-		//onRemove()
-		pool_.RemoveComponent(kv.first, kv.second);
+		if (removed.test(index))
+		{
+			removed.reset(index);
+			pool_.OnSignatureChanged(this, index);
+		}
 	}
-	components_.clear();
 }
@@ -1,16 +1,30 @@
 #pragma once
 
-#include <map>
+#include <vector>
 #include "component_pool.h"
 #include "ecs_functional.h"
 
 namespace ecs {
 	class ComponentPool;
+	class Archetype;
 	class Entity {
+		friend class BaseComponentStorage;
+		friend class Archetype;
+		friend class ArchetypeStorage;
+		friend class CommandBuffer;
+		friend class EntityAdmin;
 	private:
 		ComponentPool& pool_;
 		EntityID eid_;
-		std::map<index_t, BaseComponent*> components_;
+		//bit i is set when the entity owns the component with index i, slots_[i] points at it.
+		//tags have the bit only
+		ComponentMask signature_;
+		std::vector<void*> slots_;
+		//bits of the components whose remove event is being sent
+		ComponentMask removing_;
+		//location in archetype storage mode
+		Archetype* archetype_{ nullptr };
+		size_t row_{ 0 };
 
 	public:
 		Entity(ComponentPool& pool, EntityID eid);
@@ -29,8 +43,15 @@ namespace ecs {
 		template <typename T, typename... TArgs>
 		auto Replace(TArgs&&... args)->Entity&;
 
+		//components live in packed storages and are moved to fill the gaps of removed ones. A pointer
+		//from Get or Sibling stays valid until a T is removed from any entity or, in archetype mode, until
+		//an entity of the same archetype gains or loses a component or is destroyed. Across such changes
+		//keep the EntityID and call Get again
 		template <typename T>
 		auto Get() const->T*;
+		//like Get, and records a write for change detection
+		template <typename T>
+		T* Modify() const;
 		template <typename... Args>
 		auto Get() const -> typename std::enable_if<(sizeof...(Args) != 1), std::tuple<Args*...> >::type;
 
@@ -39,22 +60,66 @@ namespace ecs {
 		template <typename Arg0, typename... Args>
 		auto Has() const -> typename std::enable_if<sizeof...(Args) != 0, bool>::type;
 
-		BaseComponent* GetComponent(const index_t index) const;
+		const ComponentMask& Signature() const { return signature_; }
+		void* GetComponent(const index_t index) const
+		{
+			return index < slots_.size() ? slots_[index] : nullptr;
+		}
 	private:
-		Entity& AddComponent(const index_t index, BaseComponent* component);
+		Entity& AddComponent(const index_t index, void* component);
 		Entity& RemoveComponent(const index_t index);
-		Entity& ReplaceComponent(const index_t index, BaseComponent* component);
-		bool HasComponent(const index_t index) const;
+		bool HasComponent(const index_t index) const { return signature_[index]; }
 		void Destroy();
-		void ReplaceWith(const index_t index, BaseComponent* replacement);
+		void ReplaceWith(const index_t index, void* replacement);
+		void RebindComponent(const index_t index, void* component);
+		//lifecycle events for the observers, remove is sent while the component still exists
+		void NotifyAdd(const index_t index) { pool_.Notify(ComponentEvent::kAdd, this, index, GetComponent(index)); }
+		//sent once per removal, not again when an observer destroys the entity from the event
+		void NotifyRemove(const index_t index);
+		void NotifyRemoveAll();
+
+		template <typename T, typename... TArgs>
+		Entity& AddTo(const index_t index, std::false_type, TArgs&&... args);
+		template <typename T>
+		Entity& AddTo(const index_t index, std::true_type);
+		template <typename T, typename... TArgs>
+		Entity& ReplaceIn(T* component, std::false_type, TArgs&&... args);
+		template <typename T>
+		Entity& ReplaceIn(T* component, std::true_type);
+		template <typename T>
+		T* Find(const index_t index, std::false_type) const { return static_cast<T*>(GetComponent(index)); }
+		template <typename T>
+		T* Find(const index_t index, std::true_type) const { return HasComponent(index) ? details::TagInstance<T>() : nullptr; }
 
 		void DestroyAllComponent();
+		//drop the slots of components the storage already destroyed
+		void Detach(const index_t index);
+		void DetachAll();
 	};
 
 	template <typename T, typename... TArgs>
 	auto Entity::Add(TArgs&&... args) -> Entity& {
-		return AddComponent(details::ComponentIndex::index<T>(),
-			pool_.CreateComponent<T>(std::forward<TArgs>(args)...));
+		const index_t index = details::ComponentIndex::index<T>();
+		ECS_ASSERT(!HasComponent(index), "Error, cannot add component to entity, component already exists");
+		return AddTo<T>(index, IsTag<T>(), std::forward<TArgs>(args)...);
+	}
+
+	template <typename T, typename... TArgs>
+	Entity& Entity::AddTo(const index_t index, std::false_type, TArgs&&... args) {
+		T* component = pool_.CreateComponent<T>(this, std::forward<TArgs>(args)...);
+		details::SetOwner(component, this);
+		AddComponent(index, component);
+		NotifyAdd(index);
+		return *this;
+	}
+
+	//no storage and no allocation, only the signature bit
+	template <typename T>
+	Entity& Entity::AddTo(const index_t index, std::true_type) {
+		pool_.RegisterTag<T>();
+		AddComponent(index, nullptr);
+		NotifyAdd(index);
+		return *this;
 	}
 
 	template <typename Arg>
@@ -70,14 +135,43 @@ namespace ecs {
 
 	template <typename T, typename... TArgs>
 	auto Entity::Replace(TArgs&&... args) -> Entity& {
-		return ReplaceComponent(
-			details::ComponentIndex::index<T>(),
-			pool_.CreateComponent<T>(std::forward<TArgs>(args)...));
+		T* component = Get<T>();
+		if (component == nullptr)
+		{
+			return Add<T>(std::forward<TArgs>(args)...);
+		}
+		return ReplaceIn<T>(component, IsTag<T>(), std::forward<TArgs>(args)...);
+	}
+
+	//the new component takes the slot of the previous one
+	template <typename T, typename... TArgs>
+	Entity& Entity::ReplaceIn(T* component, std::false_type, TArgs&&... args) {
+		const index_t index = details::ComponentIndex::index<T>();
+		T* replaced = pool_.ReplaceComponent<T>(component, std::forward<TArgs>(args)...);
+		details::SetOwner(replaced, this);
+		pool_.Touch(this, index);
+		pool_.Notify(ComponentEvent::kReplace, this, index, replaced);
+		return *this;
+	}
+
+	template <typename T>
+	Entity& Entity::ReplaceIn(T*, std::true_type) {
+		return *this;
 	}
 
 	template <typename T>
 	auto Entity::Get() const -> T* {
-		return static_cast<T*>(GetComponent(details::ComponentIndex::index<T>()));
+		return Find<T>(details::ComponentIndex::index<T>(), IsTag<T>());
+	}
+
+	template <typename T>
+	T* Entity::Modify() const {
+		const index_t index = details::ComponentIndex::index<T>();
+		if (HasComponent(index))
+		{
+			pool_.Touch(const_cast<Entity*>(this), index);
+		}
+		return Get<T>();
 	}
 
 	template<typename ...Args>
@@ -98,7 +192,8 @@ namespace ecs {
 	template <typename Arg0, typename... Args>
 	auto Entity::Has() const ->
 		typename std::enable_if<sizeof...(Args) != 0, bool>::type {
-		return HasComponent(details::ComponentIndex::index<Arg0>()) && Has<Args...>();
+		const ComponentMask& mask = details::ComponentMaskOf<Arg0, Args...>();
+		return (signature_ & mask) == mask;
 	}
 
 }  // namespace ecs
\ No newline at end of file
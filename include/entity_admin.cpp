@@ -1,39 +1,301 @@
 #include "entity_admin.h"
-#include "entity_admin.h"
 
 using namespace ecs;
 
+EntityAdmin::EntityAdmin(StorageMode mode) : component_pool_(mode)
+{
+	scheduler_.SetClock(&component_pool_.Clock());
+	command_buffers_.emplace_back(new CommandBuffer());
+}
+
 EntityAdmin::~EntityAdmin()
 {
+	//the callbacks may refer to systems, teardown does not notify
+	component_pool_.Observers().Clear();
 	DestoryAllSysytems();
+	command_buffers_.clear();
+	DeleteDyingEntities();
 	DestroyAllEntities();
+	for (index_t id = 0; id < singletons_.size(); ++id)
+	{
+		RemoveSingleton(id);
+	}
+}
+
+void EntityAdmin::RemoveSingleton(index_t id)
+{
+	if (id < singletons_.size() && singletons_[id].instance)
+	{
+		singletons_[id].destroy(singletons_[id].instance);
+		singletons_[id] = SingletonSlot();
+	}
 }
 
 void ecs::EntityAdmin::Update(float time_step)
 {
-	for (BaseSystem* s : systems_) {
-		s->Update(time_step);
+	scheduler_.Run(time_step);
+	EndFrame();
+	PlaybackCommands();
+	FlushObservers();
+}
+
+void EntityAdmin::EndFrame()
+{
+	ComponentMask transient = component_pool_.TransientTypes();
+	for (index_t id = 0; transient.any(); ++id)
+	{
+		if (!transient.test(id))
+		{
+			continue;
+		}
+		transient.reset(id);
+		if (Mode() == StorageMode::kArchetype || component_pool_.IsTag(id))
+		{
+			RemoveAll(id);
+			continue;
+		}
+		//the storage lives in the frame arena, detach the owners and drop the blocks without swap-removing
+		BaseComponentStorage* storage = FindComponents(id);
+		if (!storage)
+		{
+			continue;
+		}
+		//observers may remove components of this storage, the owners are taken first
+		std::vector<Entity*> owners;
+		owners.reserve(storage->size());
+		for (size_t index = 0; index < storage->size(); ++index)
+		{
+			owners.push_back(storage->Owner(index));
+		}
+		for (Entity* owner : owners)
+		{
+			owner->NotifyRemove(id);
+		}
+		for (Entity* owner : owners)
+		{
+			owner->Detach(id);
+		}
+		storage->Discard();
 	}
+	FrameArena().Reset();
 }
 
-Entity * ecs::EntityAdmin::FindEntity(EntityID eid)
+void EntityAdmin::SetScheduleMode(ScheduleMode mode, size_t threads)
 {
-	auto it = entities_.find(eid);
-	return (it == entities_.end()) ? nullptr : it->second;
+	PlaybackCommands();
+	scheduler_.SetMode(mode, threads);
+	command_buffers_.clear();
+	for (size_t i = 0; i <= scheduler_.ThreadCount(); ++i)
+	{
+		command_buffers_.emplace_back(new CommandBuffer());
+	}
 }
 
+void EntityAdmin::PlaybackCommands()
+{
+	std::vector<CommandBuffer*> buffers;
+	for (std::unique_ptr<CommandBuffer>& buffer : command_buffers_)
+	{
+		if (!buffer->empty())
+		{
+			buffers.push_back(buffer.get());
+		}
+	}
+	if (!buffers.empty())
+	{
+		CommandBuffer::Playback(*this, buffers.data(), buffers.size());
+	}
+}
+
+constexpr index_t EntityAdmin::kInvalidIndex;
+
 void ecs::EntityAdmin::DestroyEntity(EntityID eid)
 {
-	auto it = entities_.find(eid);
-	if (it != entities_.end())
+	Entity* ent = FindEntity(eid);
+	if (!ent)
+	{
+		return;
+	}
+	//released first, observers of the removals cannot find the entity again
+	ReleaseEntityID(eid);
+	if (component_pool_.Notifying())
+	{
+		//an observer destroys it, the callers further up the stack may still hold it.
+		//its components go now, the memory once the observers returned
+		ent->DestroyAllComponent();
+		dying_.push_back(ent);
+		return;
+	}
+	DeleteEntity(ent);
+	DeleteDyingEntities();
+}
+
+void EntityAdmin::DeleteDyingEntities()
+{
+	if (dying_.empty() || component_pool_.Notifying())
+	{
+		return;
+	}
+	for (Entity* ent : dying_)
+	{
+		DeleteEntity(ent);
+	}
+	dying_.clear();
+}
+
+void EntityAdmin::DestroyEntities(const EntityID* ids, size_t count)
+{
+	if (component_pool_.Notifying())
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			DestroyEntity(ids[i]);
+		}
+		return;
+	}
+	std::vector<Entity*> destroyed;
+	destroyed.reserve(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		Entity* ent = FindEntity(ids[i]);
+		if (ent)
+		{
+			destroyed.push_back(ent);
+			ReleaseEntityID(ids[i]);
+		}
+	}
+	for (Entity* ent : destroyed)
+	{
+		ent->NotifyRemoveAll();
+	}
+	component_pool_.RemoveAllComponents(destroyed);
+	for (Entity* ent : destroyed)
+	{
+		ent->DetachAll();
+		DeleteEntity(ent);
+	}
+	DeleteDyingEntities();
+}
+
+void EntityAdmin::RemoveAll(index_t id)
+{
+	if (component_pool_.IsTag(id))
+	{
+		//observers may create entities, the owners are taken first
+		std::vector<Entity*> owners;
+		for (EntitySlot& slot : entities_)
+		{
+			if (slot.entity && slot.entity->HasComponent(id))
+			{
+				owners.push_back(slot.entity);
+			}
+		}
+		for (Entity* owner : owners)
+		{
+			owner->NotifyRemove(id);
+			owner->Detach(id);
+		}
+		return;
+	}
+	if (Mode() == StorageMode::kArchetype)
 	{
-		delete it->second;
-		entities_.erase(it);
+		std::vector<Entity*> owners;
+		for (const std::unique_ptr<Archetype>& archetype : GetArchetypes())
+		{
+			if (archetype->Mask().test(id))
+			{
+				for (size_t chunk = 0; chunk < archetype->ChunkCount(); ++chunk)
+				{
+					owners.insert(owners.end(), archetype->ChunkOwners(chunk), archetype->ChunkOwners(chunk) + archetype->ChunkSize(chunk));
+				}
+			}
+		}
+		for (Entity* owner : owners)
+		{
+			owner->RemoveComponent(id);
+		}
+		return;
+	}
+	BaseComponentStorage* storage = FindComponents(id);
+	if (!storage)
+	{
+		return;
+	}
+	std::vector<Entity*> owners;
+	owners.reserve(storage->size());
+	for (size_t index = 0; index < storage->size(); ++index)
+	{
+		owners.push_back(storage->Owner(index));
+	}
+	for (Entity* owner : owners)
+	{
+		owner->NotifyRemove(id);
+	}
+	storage->Clear();
+	for (Entity* owner : owners)
+	{
+		owner->Detach(id);
 	}
 }
 
+void EntityAdmin::DeleteEntity(Entity* ent)
+{
+	const index_t index = EntityIndex(ent->GetEntityID());
+	ent->~Entity();
+	entity_allocator_.Free(ent);
+	//storages and queries know the entity by its slot index until it is gone
+	if (free_tail_ == kInvalidIndex)
+	{
+		free_head_ = index;
+	}
+	else
+	{
+		entities_[free_tail_].next_free = index;
+	}
+	free_tail_ = index;
+	++free_count_;
+}
+
+void EntityAdmin::ReleaseEntityID(EntityID eid)
+{
+	EntitySlot& slot = entities_[EntityIndex(eid)];
+	slot.entity = nullptr;
+	//generation 0 is skipped so that no valid id is kInvalidEntityID
+	slot.generation = (slot.generation + 1) & kEntityGenerationMask;
+	if (slot.generation == 0)
+	{
+		slot.generation = 1;
+	}
+	--entity_count_;
+}
+
+EntityID EntityAdmin::GenerateEntityID()
+{
+	index_t index = kInvalidIndex;
+	//a slot released just now waits so its stale ids keep failing, unless the indices ran out
+	if (free_count_ > 0 && (free_count_ >= ECS_MIN_FREE_ENTITY_SLOTS || entities_.size() > kEntityIndexMask))
+	{
+		index = free_head_;
+		free_head_ = entities_[index].next_free;
+		entities_[index].next_free = kInvalidIndex;
+		if (free_head_ == kInvalidIndex)
+		{
+			free_tail_ = kInvalidIndex;
+		}
+		--free_count_;
+	}
+	else
+	{
+		ECS_ASSERT(entities_.size() <= kEntityIndexMask, "Too many entities, define ECS_64BIT_ENTITY_ID");
+		index = index_t(entities_.size());
+		entities_.emplace_back();
+	}
+	return MakeEntityID(index, entities_[index].generation);
+}
+
 void EntityAdmin::DestoryAllSysytems()
 {
+	scheduler_.Clear();
 	for (BaseSystem* sys : systems_)
 	{
 		delete sys;
@@ -43,14 +305,16 @@ void EntityAdmin::DestoryAllSysytems()
 
 void EntityAdmin::DestroyAllEntities()
 {
-	for (auto& kv : entities_)
+	for (EntitySlot& slot : entities_)
 	{
-		delete kv.second;
+		if (slot.entity)
+		{
+			DeleteEntity(slot.entity);
+		}
 	}
 	entities_.clear();
-}
-
-ComponentVector& EntityAdmin::GetAllComponents(index_t id)
-{
-	return component_pool_.GetAllComponents(id);
+	free_head_ = kInvalidIndex;
+	free_tail_ = kInvalidIndex;
+	free_count_ = 0;
+	entity_count_ = 0;
 }
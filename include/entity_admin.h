@@ -1,13 +1,19 @@
 #pragma once
 
 #include <vector>
-#include <unordered_map>
+#include <algorithm>
 #include "ecs_define.h"
 #include "ecs_functional.h"
 
 #include "entity.h"
 #include "base_system.h"
+#include "system_scheduler.h"
 #include "component_pool.h"
+#include "cached_query.h"
+#include "reactive_query.h"
+#include "query_terms.h"
+#include "command_buffer.h"
+#include "slab_allocator.h"
 
 namespace ecs
 {
@@ -15,14 +21,107 @@ namespace ecs
 	class EntityAdmin
 	{
 	private:
+		//an entity slot is reused after its entity is destroyed, the generation tells the old ids apart.
+		//Free slots are queued and the oldest is taken once ECS_MIN_FREE_ENTITY_SLOTS are free
+		struct EntitySlot
+		{
+			Entity* entity{ nullptr };
+			EntityID generation{ 1 };
+			index_t next_free{ kInvalidIndex };
+		};
+		static constexpr index_t kInvalidIndex = index_t(-1);
+		//a global component, destroy also frees the memory
+		struct SingletonSlot
+		{
+			void* instance{ nullptr };
+			void(*destroy)(void* instance){ nullptr };
+		};
+
 		std::vector<BaseSystem*> systems_;
-		std::unordered_map<EntityID, Entity*> entities_;
+		SystemScheduler scheduler_;
+		//one per worker thread plus one for every other thread, see Commands
+		std::vector<std::unique_ptr<CommandBuffer>> command_buffers_;
+		std::vector<EntitySlot> entities_;
+		//the queue of free slots, linked by next_free
+		index_t free_head_{ kInvalidIndex };
+		index_t free_tail_{ kInvalidIndex };
+		size_t free_count_{ 0 };
+		size_t entity_count_{ 0 };
+		//entities are placed in slab pages, create and destroy churn stays out of the global allocator
+		SlabAllocator entity_allocator_{ sizeof(Entity), alignof(Entity) };
+		//destroyed from observer callbacks, without components and freed once no callback runs
+		std::vector<Entity*> dying_;
 		ComponentPool component_pool_;
+		//by component index, so systems declare access to a singleton like to any component
+		std::vector<SingletonSlot> singletons_;
 
 	public:
-		EntityAdmin() = default;
+		explicit EntityAdmin(StorageMode mode = StorageMode::kComponent);
 		~EntityAdmin();
+		//runs the systems, removes the transient components, plays back the recorded commands, then
+		//delivers the deferred observer batches. Transient components added by the playback live until
+		//the end of the next Update, those added directly by a system until the end of this one.
 		void Update(float time_step);
+		//kParallel runs systems whose declared component sets do not conflict at the same time,
+		//threads is the number of workers besides the updating thread, 0 uses every core
+		void SetScheduleMode(ScheduleMode mode, size_t threads = 0);
+		ScheduleMode GetScheduleMode() const { return scheduler_.Mode(); }
+		SystemScheduler& Scheduler() { return scheduler_; }
+		//the pool of the parallel schedule mode for ParallelForEach, null in sequential mode
+		WorkerPool* Workers() const { return scheduler_.Pool(); }
+
+		//the command buffer of the calling thread, structural changes recorded there are safe while
+		//iterating and from parallel systems. They are applied by PlaybackCommands.
+		CommandBuffer& Commands()
+		{
+			WorkerPool* pool = Workers();
+			return *command_buffers_[pool ? pool->WorkerIndex() : command_buffers_.size() - 1];
+		}
+		void PlaybackCommands();
+
+		//the current change version, components written from now on record it
+		version_t ChangeVersion() const { return component_pool_.Version(); }
+		//Changed<T> terms match components written after this version: the last run of the
+		//system running on the calling thread, or 0 outside of systems
+		version_t ChangeSince() const
+		{
+			const BaseSystem* system = SystemScheduler::Current();
+			return system ? system->LastRunVersion() : 0;
+		}
+		version_t VersionOf(const Entity* ent, index_t id) const { return component_pool_.VersionOf(ent, id); }
+
+		//f(Entity&, T*) runs inside every add, remove or replace of T. T* is null for tags, and a removed
+		//component is still valid during the call. Structural changes from f are applied right away, an entity
+		//destroyed from f loses its id and components at once and its memory once the callbacks returned.
+		template<class T, typename F>
+		ObserverID Observe(ComponentEvent event, F&& f)
+		{
+			return component_pool_.Observers().AddImmediate(details::ComponentIndex::index<T>(), event,
+				[f](Entity& ent, void* component) mutable { f(ent, static_cast<T*>(component)); });
+		}
+		template<class T, typename F>
+		ObserverID OnAdd(F&& f) { return Observe<T>(ComponentEvent::kAdd, std::forward<F>(f)); }
+		template<class T, typename F>
+		ObserverID OnRemove(F&& f) { return Observe<T>(ComponentEvent::kRemove, std::forward<F>(f)); }
+		template<class T, typename F>
+		ObserverID OnReplace(F&& f) { return Observe<T>(ComponentEvent::kReplace, std::forward<F>(f)); }
+		//f(const std::vector<EntityID>&) gets the entities of the events of T since the last sync point in
+		//one batch, in event order. Update ends with a sync point, see FlushObservers. By then the entities
+		//may have changed again or be destroyed
+		template<class T>
+		ObserverID ObserveDeferred(ComponentEvent event, std::function<void(const std::vector<EntityID>&)> f)
+		{
+			return component_pool_.Observers().AddDeferred(details::ComponentIndex::index<T>(), event, std::move(f));
+		}
+		void Unobserve(ObserverID id) { component_pool_.Observers().Remove(id); }
+		void FlushObservers()
+		{
+			component_pool_.Observers().Flush();
+			DeleteDyingEntities();
+		}
+
+		//scratch memory for the current frame, it is reset at the end of every Update
+		ArenaResource& FrameArena() { return component_pool_.FrameArena(); }
 
 		template<class S>
 		S& CreateSystem();
@@ -33,20 +132,93 @@ namespace ecs
 
 		template<class E>
 		Entity& CreateEntity();
-		Entity* FindEntity(EntityID eid);
+		//creates count entities that own exactly Cs, reserving entity slots and component storage once.
+		//the components are default constructed and initializer(i, Cs*...) fills those of the i-th entity.
+		template<class... Cs, typename F>
+		std::vector<EntityID> CreateEntities(size_t count, F&& initializer);
+		template<class... Cs>
+		std::vector<EntityID> CreateEntities(size_t count)
+		{
+			return CreateEntities<Cs...>(count, [](size_t, Cs*...) {});
+		}
+		Entity* FindEntity(EntityID eid) const
+		{
+			index_t index = EntityIndex(eid);
+			return (index < entities_.size() && entities_[index].generation == EntityGeneration(eid)) ? entities_[index].entity : nullptr;
+		}
+		bool IsAlive(EntityID eid) const { return FindEntity(eid) != nullptr; }
+
+		//returns the registered query for Args, registering it on first use.
+		//it stays up to date as components are added and removed.
+		template<class... Args>
+		CachedQuery<Args...>& Query() { return FindOrAddQuery<CachedQuery<Args...>>(); }
+		//returns the registered reactive query for Args, registering it on first use.
+		//Poll it for the entities that started or stopped matching, the work is proportional to the churn
+		template<class... Args>
+		ReactiveQuery<Args...>& Reactive() { return FindOrAddQuery<ReactiveQuery<Args...>>(); }
 		void DestroyEntity(EntityID eid);
+		//destroys many entities at once, their components are removed storage by storage.
+		//stale and repeated ids are ignored
+		void DestroyEntities(const EntityID* ids, size_t count);
+		void DestroyEntities(const std::vector<EntityID>& ids) { DestroyEntities(ids.data(), ids.size()); }
+		//removes C from every entity that has it
+		template<class C>
+		void RemoveAll() { RemoveAll(details::ComponentIndex::index<C>()); }
+		void RemoveAll(index_t id);
+		size_t EntityCount() const { return entity_count_; }
+		const SlabAllocator::Stats& EntityAllocatorStats() const { return entity_allocator_.GetStats(); }
+
+		StorageMode Mode() const { return component_pool_.Mode(); }
+		//registering a component type up front keeps storage creation out of queries
+		//resource places the storage blocks of C, e.g. a PoolResource for high churn types. It must outlive the admin
+		template<class C>
+		void RegisterComponent(size_t reserve = 0, MemoryResource* resource = nullptr) { component_pool_.RegisterComponent<C>(reserve, resource); }
+		//component mode only, archetype mode keeps components in GetArchetypes()
+		template<class C>
+		ComponentStorage<C>& GetAllComponents() { return component_pool_.GetAllComponents<C>(); }
+		BaseComponentStorage* FindComponents(index_t id) const { return component_pool_.FindComponents(id); }
+		const ArchetypeList& GetArchetypes() const { return component_pool_.GetArchetypes(); }
+		//the handle of the shared value built from args, entities get it through Add<Shared<T>>(handle).
+		//handles must not outlive the admin
+		template<class T, typename... Args>
+		Shared<T> MakeShared(Args&&... args) { return component_pool_.MakeShared<T>(std::forward<Args>(args)...); }
+		template<class T>
+		SharedStorage<T>& GetSharedValues() { return component_pool_.GetSharedValues<T>(); }
 
-		//you can use your entity pool to generate eid
-		EntityID GenerateEntityID()
+		//global state owned by the admin instead of a dummy entity. T is built like a component from args,
+		//setting it again replaces the previous value and invalidates pointers to it.
+		//systems using it declare Read<T>() or Write<T>(), singletons are not set from parallel systems
+		template<class T, typename... Args>
+		T& SetSingleton(Args&&... args);
+		//null until SetSingleton<T>
+		template<class T>
+		T* Singleton() const
 		{
-			static EntityID start_id = 0;
-			return ++start_id;
+			const index_t id = details::ComponentIndex::index<T>();
+			return id < singletons_.size() ? static_cast<T*>(singletons_[id].instance) : nullptr;
 		}
-
-		ComponentVector& GetAllComponents(index_t id);
+		template<class T>
+		void RemoveSingleton() { RemoveSingleton(details::ComponentIndex::index<T>()); }
 	private:
+		//takes the oldest free slot or a new one, ids of destroyed entities come back with the next generation
+		EntityID GenerateEntityID();
+		//its id stops resolving, the slot is reused once DeleteEntity ran
+		void ReleaseEntityID(EntityID eid);
+		//destroys the entity and queues its slot
+		void DeleteEntity(Entity* ent);
+		void DeleteDyingEntities();
+		void RemoveSingleton(index_t id);
+		//removes every transient component and resets the frame arena
+		void EndFrame();
 		void DestoryAllSysytems();
+		template<typename F, typename Tuple, size_t... I>
+		static void Initialize(F& initializer, size_t i, const Tuple& components, std::index_sequence<I...>)
+		{
+			initializer(i, std::get<I>(components)...);
+		}
 		void DestroyAllEntities();
+		template<class Q>
+		Q& FindOrAddQuery();
 	};
 
 	template<class S>
@@ -60,6 +232,7 @@ namespace ecs
 		}
 		S* sys = new S(this);
 		systems_[system_index] = sys;
+		scheduler_.Add(sys);
 		return *sys;
 	}
 
@@ -68,6 +241,7 @@ namespace ecs
 	{
 		ECS_ASSERT_IS_SYSTEM(S);
 		ECS_ASSERT(HasSystem<S>(), "System not exist");
+		scheduler_.Remove(systems_[details::SystemIndex::index<S>()]);
 		delete systems_[details::SystemIndex::index<S>()];
 		systems_[details::SystemIndex::index<S>()] = nullptr;
 	}
@@ -79,13 +253,96 @@ namespace ecs
 		return systems_.size() > details::SystemIndex::index<S>() && systems_[details::SystemIndex::index<S>()] != nullptr;
 	}
 
+	template<class Q>
+	Q& EntityAdmin::FindOrAddQuery()
+	{
+		index_t query_index = details::QueryIndex::index<Q>();
+		BaseQuery* query = component_pool_.FindQuery(query_index);
+		if (!query)
+		{
+			query = new Q();
+			component_pool_.AddQuery(query_index, std::unique_ptr<BaseQuery>(query));
+			for (EntitySlot& slot : entities_)
+			{
+				if (slot.entity)
+				{
+					query->Update(slot.entity);
+				}
+			}
+		}
+		return *static_cast<Q*>(query);
+	}
+
+	template<class T, typename... Args>
+	T& EntityAdmin::SetSingleton(Args&&... args)
+	{
+		const index_t id = details::ComponentIndex::index<T>();
+		if (id >= singletons_.size())
+		{
+			singletons_.resize(id + 1);
+		}
+		//own cache line, systems writing different singletons do not share one
+		void* memory = details::AlignedAlloc(sizeof(T), std::max(alignof(T), BaseComponentStorage::kCacheLineSize));
+		T* instance = nullptr;
+		try
+		{
+			instance = details::ConstructComponent<T>(memory, std::forward<Args>(args)...);
+		}
+		catch (...)
+		{
+			details::AlignedFree(memory);
+			throw;
+		}
+		RemoveSingleton(id);
+		singletons_[id].instance = instance;
+		singletons_[id].destroy = [](void* p) {
+			static_cast<T*>(p)->~T();
+			details::AlignedFree(p);
+		};
+		return *instance;
+	}
+
+	template<class... Cs, typename F>
+	std::vector<EntityID> EntityAdmin::CreateEntities(size_t count, F&& initializer)
+	{
+		static_assert(details::conjunction_v<IsComponent<Cs>...> && (sizeof...(Cs) > 0), "invalid argument type!");
+		static_assert(details::conjunction_v<std::integral_constant<bool, !IsTag<Cs>::value>...>, "tags are added to the created entities afterwards");
+		const index_t ids[] = { details::ComponentIndex::index<Cs>()... };
+		std::vector<EntityID> created;
+		created.reserve(count);
+		entities_.reserve(entities_.size() + count);
+		entity_allocator_.Reserve(count);
+		Archetype* target = component_pool_.ReserveComponents<Cs...>(count);
+		for (size_t i = 0; i < count; ++i)
+		{
+			Entity& ent = CreateEntity<Entity>();
+			std::tuple<Cs*...> components = component_pool_.EmplaceComponents<Cs...>(target, &ent);
+			void* slots[] = { std::get<Cs*>(components)... };
+			int expand[] = { 0, (details::SetOwner(std::get<Cs*>(components), &ent), 0)... };
+			(void)expand;
+			for (size_t c = 0; c < sizeof...(Cs); ++c)
+			{
+				ent.AddComponent(ids[c], slots[c]);
+			}
+			Initialize(initializer, i, components, std::index_sequence_for<Cs...>());
+			//observers see the initialized values
+			for (size_t c = 0; c < sizeof...(Cs); ++c)
+			{
+				ent.NotifyAdd(ids[c]);
+			}
+			created.push_back(ent.GetEntityID());
+		}
+		return created;
+	}
+
 	template<class E>
 	Entity& ecs::EntityAdmin::CreateEntity()
 	{
 		ECS_ASSERT_IS_ENTITY(E);
 		EntityID eid = GenerateEntityID();
-		Entity* ent = new E(component_pool_, eid);
-		entities_.insert(std::make_pair(eid, ent));
+		Entity* ent = new (entity_allocator_.Allocate()) E(component_pool_, eid);
+		entities_[EntityIndex(eid)].entity = ent;
+		++entity_count_;
 		return *ent;
 	}
 
@@ -0,0 +1,115 @@
+#include "memory_resource.h"
+#include "component_storage.h"
+#include <algorithm>
+
+using namespace ecs;
+
+constexpr size_t ArenaResource::kPageBytes;
+
+namespace
+{
+	class AlignedResource : public MemoryResource
+	{
+	protected:
+		void* DoAllocate(size_t bytes, size_t alignment) override { return details::AlignedAlloc(bytes, alignment); }
+		void DoDeallocate(void* ptr, size_t, size_t) override { details::AlignedFree(ptr); }
+	};
+}
+
+MemoryResource* ecs::DefaultResource()
+{
+	static AlignedResource resource;
+	return &resource;
+}
+
+PoolResource::~PoolResource()
+{
+	for (Bucket& bucket : buckets_)
+	{
+		for (void* block : bucket.blocks)
+		{
+			upstream_->Deallocate(block, bucket.bytes, bucket.alignment);
+		}
+	}
+}
+
+size_t PoolResource::Cached() const
+{
+	size_t cached = 0;
+	for (const Bucket& bucket : buckets_)
+	{
+		cached += bucket.blocks.size();
+	}
+	return cached;
+}
+
+PoolResource::Bucket& PoolResource::Find(size_t bytes, size_t alignment)
+{
+	for (Bucket& bucket : buckets_)
+	{
+		if (bucket.bytes == bytes && bucket.alignment == alignment)
+		{
+			return bucket;
+		}
+	}
+	buckets_.push_back(Bucket{ bytes, alignment, {} });
+	return buckets_.back();
+}
+
+void* PoolResource::DoAllocate(size_t bytes, size_t alignment)
+{
+	Bucket& bucket = Find(bytes, alignment);
+	if (bucket.blocks.empty())
+	{
+		++upstream_allocations_;
+		return upstream_->Allocate(bytes, alignment);
+	}
+	void* block = bucket.blocks.back();
+	bucket.blocks.pop_back();
+	return block;
+}
+
+void PoolResource::DoDeallocate(void* ptr, size_t bytes, size_t alignment)
+{
+	Find(bytes, alignment).blocks.push_back(ptr);
+}
+
+void ArenaResource::Reset()
+{
+	page_ = 0;
+	offset_ = 0;
+	used_ = 0;
+}
+
+void ArenaResource::Release()
+{
+	for (Page& page : pages_)
+	{
+		upstream_->Deallocate(page.data, page.bytes, BaseComponentStorage::kCacheLineSize);
+	}
+	pages_.clear();
+	Reset();
+}
+
+void* ArenaResource::DoAllocate(size_t bytes, size_t alignment)
+{
+	while (page_ < pages_.size())
+	{
+		Page& page = pages_[page_];
+		uintptr_t begin = reinterpret_cast<uintptr_t>(page.data);
+		uintptr_t address = (begin + offset_ + alignment - 1) & ~(uintptr_t(alignment) - 1);
+		if (address + bytes <= begin + page.bytes)
+		{
+			offset_ = size_t(address + bytes - begin);
+			used_ += bytes;
+			return reinterpret_cast<void*>(address);
+		}
+		++page_;
+		offset_ = 0;
+	}
+	size_t page_bytes = std::max(kPageBytes, bytes + alignment);
+	pages_.push_back(Page{ static_cast<char*>(upstream_->Allocate(page_bytes, BaseComponentStorage::kCacheLineSize)), page_bytes });
+	page_ = pages_.size() - 1;
+	offset_ = 0;
+	return DoAllocate(bytes, alignment);
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <vector>
+#include "ecs_define.h"
+
+namespace ecs
+{
+	//where component storages get their blocks from, modelled after std::pmr::memory_resource
+	//which C++14 does not have. Resources are not thread safe and must outlive their users.
+	class MemoryResource
+	{
+	public:
+		virtual ~MemoryResource() = default;
+
+		void* Allocate(size_t bytes, size_t alignment) { return DoAllocate(bytes, alignment); }
+		void Deallocate(void* ptr, size_t bytes, size_t alignment) { DoDeallocate(ptr, bytes, alignment); }
+
+	protected:
+		virtual void* DoAllocate(size_t bytes, size_t alignment) = 0;
+		virtual void DoDeallocate(void* ptr, size_t bytes, size_t alignment) = 0;
+	};
+
+	//aligned malloc and free
+	MemoryResource* DefaultResource();
+
+	//keeps deallocated blocks by size and hands them out again, memory goes back upstream on destruction
+	class PoolResource : public MemoryResource
+	{
+	private:
+		struct Bucket
+		{
+			size_t bytes;
+			size_t alignment;
+			std::vector<void*> blocks;
+		};
+
+		MemoryResource* upstream_;
+		std::vector<Bucket> buckets_;
+		size_t upstream_allocations_{ 0 };
+
+	public:
+		explicit PoolResource(MemoryResource* upstream = DefaultResource()) : upstream_(upstream) {}
+		~PoolResource() override;
+		PoolResource(const PoolResource&) = delete;
+		PoolResource& operator=(const PoolResource&) = delete;
+
+		size_t UpstreamAllocations() const { return upstream_allocations_; }
+		size_t Cached() const;
+
+	protected:
+		void* DoAllocate(size_t bytes, size_t alignment) override;
+		void DoDeallocate(void* ptr, size_t bytes, size_t alignment) override;
+	private:
+		Bucket& Find(size_t bytes, size_t alignment);
+	};
+
+	//bump allocation from large pages, deallocation does nothing. Reset hands out the pages again,
+	//it is only safe once nothing allocated since the last Reset is in use.
+	class ArenaResource : public MemoryResource
+	{
+	public:
+		static constexpr size_t kPageBytes = 64 * 1024;
+
+	private:
+		struct Page
+		{
+			char* data;
+			size_t bytes;
+		};
+
+		MemoryResource* upstream_;
+		std::vector<Page> pages_;
+		size_t page_{ 0 };
+		size_t offset_{ 0 };
+		size_t used_{ 0 };
+
+	public:
+		explicit ArenaResource(MemoryResource* upstream = DefaultResource()) : upstream_(upstream) {}
+		~ArenaResource() override { Release(); }
+		ArenaResource(const ArenaResource&) = delete;
+		ArenaResource& operator=(const ArenaResource&) = delete;
+
+		void Reset();
+		//returns every page upstream
+		void Release();
+		//bytes handed out since the last Reset
+		size_t Used() const { return used_; }
+		size_t PageCount() const { return pages_.size(); }
+
+	protected:
+		void* DoAllocate(size_t bytes, size_t alignment) override;
+		void DoDeallocate(void*, size_t, size_t) override {}
+	};
+
+	//specialize to place the storage blocks of C in another resource, RegisterComponent can override it
+	template <class C>
+	struct ComponentResource
+	{
+		static MemoryResource* Get() { return DefaultResource(); }
+	};
+}
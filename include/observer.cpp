@@ -0,0 +1,141 @@
+#include "observer.h"
+#include "entity.h"
+#include <algorithm>
+
+using namespace ecs;
+
+constexpr size_t ObserverList::kEventCount;
+
+ObserverID ObserverList::AddImmediate(index_t component, ComponentEvent event, std::function<void(Entity&, void*)> f)
+{
+	std::unique_ptr<Observer> observer(new Observer());
+	observer->component = component;
+	observer->event = event;
+	observer->immediate = std::move(f);
+	return Link(std::move(observer));
+}
+
+ObserverID ObserverList::AddDeferred(index_t component, ComponentEvent event, std::function<void(const std::vector<EntityID>&)> f)
+{
+	std::unique_ptr<Observer> observer(new Observer());
+	observer->component = component;
+	observer->event = event;
+	observer->deferred = std::move(f);
+	return Link(std::move(observer));
+}
+
+ObserverID ObserverList::Link(std::unique_ptr<Observer> observer)
+{
+	std::vector<std::vector<ObserverID>>& watching = watching_[size_t(observer->event)];
+	if (observer->component >= watching.size())
+	{
+		watching.resize(observer->component + 1);
+	}
+	const ObserverID id = ObserverID(observers_.size());
+	watching[observer->component].push_back(id);
+	watched_[size_t(observer->event)].set(observer->component);
+	observers_.push_back(std::move(observer));
+	return id;
+}
+
+void ObserverList::Remove(ObserverID id)
+{
+	if (id >= observers_.size() || !observers_[id]->active)
+	{
+		return;
+	}
+	observers_[id]->active = false;
+	unlinked_ = true;
+	if (depth_ == 0)
+	{
+		Unlink();
+	}
+}
+
+void ObserverList::Unlink()
+{
+	for (size_t event = 0; event < kEventCount; ++event)
+	{
+		for (index_t component = 0; component < watching_[event].size(); ++component)
+		{
+			std::vector<ObserverID>& ids = watching_[event][component];
+			ids.erase(std::remove_if(ids.begin(), ids.end(), [this](ObserverID id) { return !observers_[id]->active; }), ids.end());
+			watched_[event].set(component, !ids.empty());
+		}
+	}
+	//the ids stay reserved, only the callbacks and batches are released
+	for (std::unique_ptr<Observer>& observer : observers_)
+	{
+		if (!observer->active)
+		{
+			observer->immediate = nullptr;
+			observer->deferred = nullptr;
+			std::vector<EntityID>().swap(observer->pending);
+		}
+	}
+	unlinked_ = false;
+}
+
+void ObserverList::Clear()
+{
+	observers_.clear();
+	for (size_t event = 0; event < kEventCount; ++event)
+	{
+		watching_[event].clear();
+		watched_[event].reset();
+	}
+	unlinked_ = false;
+}
+
+void ObserverList::Notify(ComponentEvent event, Entity& ent, index_t component, void* instance)
+{
+	++depth_;
+	//looked up again every time, callbacks may register observers and grow watching_
+	for (size_t i = 0; i < watching_[size_t(event)][component].size(); ++i)
+	{
+		Observer& observer = *observers_[watching_[size_t(event)][component][i]];
+		if (!observer.active)
+		{
+			continue;
+		}
+		if (observer.immediate)
+		{
+			observer.immediate(ent, instance);
+		}
+		else
+		{
+			observer.pending.push_back(ent.GetEntityID());
+		}
+	}
+	if (--depth_ == 0 && unlinked_)
+	{
+		Unlink();
+	}
+}
+
+void ObserverList::Flush()
+{
+	++depth_;
+	std::vector<EntityID> batch;
+	bool delivered = true;
+	while (delivered)
+	{
+		delivered = false;
+		for (size_t id = 0; id < observers_.size(); ++id)
+		{
+			Observer& observer = *observers_[id];
+			if (!observer.active || observer.pending.empty())
+			{
+				continue;
+			}
+			batch.clear();
+			batch.swap(observer.pending);
+			observer.deferred(batch);
+			delivered = true;
+		}
+	}
+	if (--depth_ == 0 && unlinked_)
+	{
+		Unlink();
+	}
+}
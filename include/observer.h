@@ -0,0 +1,67 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <vector>
+#include "ecs_define.h"
+
+namespace ecs
+{
+	class Entity;
+
+	//add fires once the component is built and in the signature, remove before the component is
+	//destroyed, replace once the new value is in place. Tags fire add and remove with a null component.
+	enum class ComponentEvent : uint8_t
+	{
+		kAdd,
+		kRemove,
+		kReplace,
+	};
+	using ObserverID = index_t;
+
+	//the observers of component lifecycle events by component type. Immediate observers run inside the
+	//change, deferred ones collect entity ids that are handed over in one batch by Flush.
+	class ObserverList
+	{
+	private:
+		struct Observer
+		{
+			index_t component;
+			ComponentEvent event;
+			std::function<void(Entity&, void*)> immediate;
+			std::function<void(const std::vector<EntityID>&)> deferred;
+			std::vector<EntityID> pending;
+			bool active{ true };
+		};
+		static constexpr size_t kEventCount = 3;
+
+		//by id, observers are not moved so callbacks can register more of them
+		std::vector<std::unique_ptr<Observer>> observers_;
+		//ids by event and component index
+		std::vector<std::vector<ObserverID>> watching_[kEventCount];
+		ComponentMask watched_[kEventCount];
+		//observers removed from a callback are unlinked once the outermost callback returned
+		int depth_{ 0 };
+		bool unlinked_{ false };
+
+	public:
+		ObserverList() = default;
+		ObserverList(const ObserverList&) = delete;
+		ObserverList& operator=(const ObserverList&) = delete;
+
+		ObserverID AddImmediate(index_t component, ComponentEvent event, std::function<void(Entity&, void*)> f);
+		ObserverID AddDeferred(index_t component, ComponentEvent event, std::function<void(const std::vector<EntityID>&)> f);
+		void Remove(ObserverID id);
+		void Clear();
+
+		bool Watches(ComponentEvent event, index_t component) const { return watched_[size_t(event)].test(component); }
+		bool Notifying() const { return depth_ > 0; }
+		void Notify(ComponentEvent event, Entity& ent, index_t component, void* instance);
+		//hands the pending batches over in registration order, including those the batches cause
+		void Flush();
+
+	private:
+		ObserverID Link(std::unique_ptr<Observer> observer);
+		void Unlink();
+	};
+}
@@ -0,0 +1,214 @@
+#pragma once
+
+#include <functional>
+#include <tuple>
+#include "ecs_functional.h"
+#include "base_component.h"
+
+namespace ecs
+{
+	//any class type but BaseComponent itself, plain structs included
+	template<typename T>
+	struct IsComponent : std::integral_constant<bool, std::is_class<T>::value && !std::is_same<BaseComponent, T>::value> {};
+	template<typename T>
+	constexpr bool IsComponent_v = IsComponent<T>::value;
+
+	template<typename T>
+	struct IsComponentPointer : std::integral_constant<bool, IsComponent_v<std::remove_pointer<T>> && !std::is_pointer<T>::value> {};
+	template<typename T>
+	constexpr bool IsComponentPointer_v = IsComponentPointer<T>::value;
+
+	//query terms besides plain component types:
+	//entities owning any of Ts are skipped, an optional component is yielded as a pointer that may be null
+	template <typename... Ts>
+	struct Exclude {};
+	template <typename T>
+	struct Optional {};
+	//change detection terms, both yield T*: Changed<T> only matches components written since the
+	//last run of the current system, Mut<T> records a write for every entity the loop visits
+	template <typename T>
+	struct Changed {};
+	template <typename T>
+	struct Mut {};
+
+	namespace details
+	{
+		//kRequired terms have a column to read, tag terms only add their bit to the masks
+		template <typename T>
+		struct QueryTerm
+		{
+			using Yield = std::conditional_t<IsTag<T>::value, std::tuple<>, std::tuple<T*>>;
+			static constexpr bool kValid = IsComponent_v<T>;
+			static constexpr bool kRequired = !IsTag<T>::value;
+			static constexpr bool kTag = IsTag<T>::value;
+			static constexpr bool kChanged = false;
+			static constexpr bool kMut = false;
+			static index_t Index() { return kTag ? index_t(-1) : ComponentIndex::index<T>(); }
+			static void AddTo(ComponentMask& required, ComponentMask&, ComponentMask& tags)
+			{
+				required.set(ComponentIndex::index<T>());
+				tags.set(ComponentIndex::index<T>(), kTag);
+			}
+		};
+
+		template <typename T>
+		struct QueryTerm<Optional<T>>
+		{
+			using Yield = std::tuple<T*>;
+			static constexpr bool kValid = IsComponent_v<T>;
+			static constexpr bool kRequired = false;
+			static constexpr bool kTag = false;
+			static constexpr bool kChanged = false;
+			static constexpr bool kMut = false;
+			static index_t Index() { return ComponentIndex::index<T>(); }
+			static void AddTo(ComponentMask&, ComponentMask&, ComponentMask&) {}
+		};
+
+		//tags have no data to version or write
+		template <typename T, bool Changed, bool Mut>
+		struct VersionedTerm
+		{
+			using Yield = std::tuple<T*>;
+			static constexpr bool kValid = IsComponent_v<T> && !IsTag<T>::value;
+			static constexpr bool kRequired = true;
+			static constexpr bool kTag = false;
+			static constexpr bool kChanged = Changed;
+			static constexpr bool kMut = Mut;
+			static index_t Index() { return ComponentIndex::index<T>(); }
+			static void AddTo(ComponentMask& required, ComponentMask&, ComponentMask&)
+			{
+				required.set(ComponentIndex::index<T>());
+			}
+		};
+		template <typename T>
+		struct QueryTerm<Changed<T>> : VersionedTerm<T, true, false> {};
+		template <typename T>
+		struct QueryTerm<Mut<T>> : VersionedTerm<T, false, true> {};
+
+		template <typename... Ts>
+		struct QueryTerm<Exclude<Ts...>>
+		{
+			using Yield = std::tuple<>;
+			static constexpr bool kValid = conjunction_v<IsComponent<Ts>...>;
+			static constexpr bool kRequired = false;
+			static constexpr bool kTag = false;
+			static constexpr bool kChanged = false;
+			static constexpr bool kMut = false;
+			static index_t Index() { return index_t(-1); }
+			static void AddTo(ComponentMask&, ComponentMask& excluded, ComponentMask& tags)
+			{
+				int expand[] = { 0, (excluded.set(ComponentIndex::index<Ts>()), tags.set(ComponentIndex::index<Ts>(), IsTag<Ts>::value), 0)... };
+				(void)expand;
+			}
+		};
+
+		//the pointers a query yields, Exclude terms yield nothing
+		template <typename... Args>
+		using QueryYield = decltype(std::tuple_cat(std::declval<typename QueryTerm<Args>::Yield>()...));
+
+		template <typename Tuple>
+		struct QueryFilter;
+		template <typename... Ps>
+		struct QueryFilter<std::tuple<Ps...>>
+		{
+			using type = std::function<bool(Ps...)>;
+		};
+
+		template <typename... Args>
+		constexpr size_t RequiredCount()
+		{
+			const bool required[] = { false, QueryTerm<Args>::kRequired... };
+			size_t count = 0;
+			for (bool r : required)
+			{
+				count += r ? 1 : 0;
+			}
+			return count;
+		}
+		template <typename... Args>
+		constexpr size_t TagCount()
+		{
+			const bool tags[] = { false, QueryTerm<Args>::kTag... };
+			size_t count = 0;
+			for (bool t : tags)
+			{
+				count += t ? 1 : 0;
+			}
+			return count;
+		}
+		template <typename... Args>
+		constexpr size_t ChangedCount()
+		{
+			const bool changed[] = { false, QueryTerm<Args>::kChanged... };
+			size_t count = 0;
+			for (bool c : changed)
+			{
+				count += c ? 1 : 0;
+			}
+			return count;
+		}
+
+		//pointers of one term looked up through the entity, E is a template parameter as Entity is incomplete here
+		template <typename T, typename E>
+		std::tuple<T*> FetchComponent(const E* ent, std::false_type) { return std::tuple<T*>(ent->template Get<T>()); }
+		template <typename T, typename E>
+		std::tuple<> FetchComponent(const E*, std::true_type) { return std::tuple<>(); }
+
+		template <typename T, typename E>
+		typename QueryTerm<T>::Yield FetchTerm(const E* ent, QueryTerm<T>) { return FetchComponent<T>(ent, IsTag<T>()); }
+		template <typename T, typename E>
+		std::tuple<T*> FetchTerm(const E* ent, QueryTerm<Optional<T>>) { return std::tuple<T*>(ent->template Get<T>()); }
+		template <typename... Ts, typename E>
+		std::tuple<> FetchTerm(const E*, QueryTerm<Exclude<Ts...>>) { return std::tuple<>(); }
+		template <typename T, typename E>
+		std::tuple<T*> FetchTerm(const E* ent, QueryTerm<Changed<T>>) { return std::tuple<T*>(ent->template Get<T>()); }
+		template <typename T, typename E>
+		std::tuple<T*> FetchTerm(const E* ent, QueryTerm<Mut<T>>) { return std::tuple<T*>(ent->template Get<T>()); }
+
+		template <typename... Args, typename E>
+		QueryYield<Args...> FetchTerms(const E* ent) { return std::tuple_cat(FetchTerm(ent, QueryTerm<Args>())...); }
+
+		//records the writes of the Mut terms, once the entity is known to match
+		template <typename T, typename E>
+		void TouchTerm(const E*, QueryTerm<T>) {}
+		template <typename T, typename E>
+		void TouchTerm(const E* ent, QueryTerm<Mut<T>>) { ent->template Modify<T>(); }
+		template <typename... Args, typename E>
+		void TouchTerms(const E* ent)
+		{
+			int expand[] = { 0, (TouchTerm(ent, QueryTerm<Args>()), 0)... };
+			(void)expand;
+		}
+
+		//signature bits an entity must have and must not have to match the terms,
+		//tags marks the bits of tag terms in either mask
+		template <typename... Args>
+		struct QueryMasks
+		{
+			ComponentMask required;
+			ComponentMask excluded;
+			ComponentMask tags;
+
+			static const QueryMasks& Get()
+			{
+				static const QueryMasks masks;
+				return masks;
+			}
+			bool Matches(const ComponentMask& signature) const
+			{
+				return (signature & required) == required && (signature & excluded).none();
+			}
+			//archetype masks never hold tag bits, those are tested per entity
+			bool MatchesColumns(const ComponentMask& mask) const
+			{
+				return Matches(mask | (required & tags));
+			}
+		private:
+			QueryMasks()
+			{
+				int expand[] = { 0, (QueryTerm<Args>::AddTo(required, excluded, tags), 0)... };
+				(void)expand;
+			}
+		};
+	}
+}
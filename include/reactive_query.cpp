@@ -0,0 +1,70 @@
+#include "reactive_query.h"
+#include "entity.h"
+
+using namespace ecs;
+
+void BaseReactiveQuery::Poll(std::vector<EntityID>& added, std::vector<EntityID>& removed)
+{
+	Forget(added_, added_positions_);
+	Forget(removed_, removed_positions_);
+	added.swap(added_);
+	removed.swap(removed_);
+	added_.clear();
+	removed_.clear();
+}
+
+void BaseReactiveQuery::OnEnter(Entity* ent)
+{
+	//it left and came back, nothing changed since the last Poll
+	if (!Cancel(removed_, removed_positions_, ent->GetEntityID()))
+	{
+		Push(added_, added_positions_, ent->GetEntityID());
+	}
+}
+
+void BaseReactiveQuery::OnLeave(Entity* ent)
+{
+	if (!Cancel(added_, added_positions_, ent->GetEntityID()))
+	{
+		Push(removed_, removed_positions_, ent->GetEntityID());
+	}
+}
+
+bool BaseReactiveQuery::Cancel(std::vector<EntityID>& buffer, std::vector<index_t>& positions, EntityID eid)
+{
+	const index_t entity_index = EntityIndex(eid);
+	if (entity_index >= positions.size() || positions[entity_index] == kInvalidPosition)
+	{
+		return false;
+	}
+	//an older entity of the same slot is a different one
+	const index_t position = positions[entity_index];
+	if (buffer[position] != eid)
+	{
+		return false;
+	}
+	buffer[position] = buffer.back();
+	positions[EntityIndex(buffer[position])] = position;
+	positions[entity_index] = kInvalidPosition;
+	buffer.pop_back();
+	return true;
+}
+
+void BaseReactiveQuery::Push(std::vector<EntityID>& buffer, std::vector<index_t>& positions, EntityID eid)
+{
+	const index_t entity_index = EntityIndex(eid);
+	if (entity_index >= positions.size())
+	{
+		positions.resize(entity_index + 1, kInvalidPosition);
+	}
+	positions[entity_index] = index_t(buffer.size());
+	buffer.push_back(eid);
+}
+
+void BaseReactiveQuery::Forget(const std::vector<EntityID>& buffer, std::vector<index_t>& positions)
+{
+	for (EntityID eid : buffer)
+	{
+		positions[EntityIndex(eid)] = kInvalidPosition;
+	}
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <vector>
+#include "base_query.h"
+#include "query_terms.h"
+
+namespace ecs
+{
+	//a registered query that reports how its matches changed, see EntityAdmin::Reactive. The buffers
+	//only hold the net change since the last Poll: an entity that starts and stops matching in
+	//between is in neither of them. The entities matching at registration are reported as added.
+	class BaseReactiveQuery : public BaseQuery
+	{
+	private:
+		std::vector<EntityID> added_;
+		std::vector<EntityID> removed_;
+		//position in added_ and removed_ by entity index
+		std::vector<index_t> added_positions_;
+		std::vector<index_t> removed_positions_;
+
+	public:
+		BaseReactiveQuery(const ComponentMask& mask, const ComponentMask& excluded) : BaseQuery(mask, excluded) {}
+
+		//the entities that started and stopped matching since the last Poll, in no particular order.
+		//added entities still match, removed ones may be destroyed by now
+		const std::vector<EntityID>& Added() const { return added_; }
+		const std::vector<EntityID>& Removed() const { return removed_; }
+		//hands both buffers over and starts new ones, the previous contents of added and removed
+		//are dropped and their memory is reused
+		void Poll(std::vector<EntityID>& added, std::vector<EntityID>& removed);
+
+	protected:
+		void OnEnter(Entity* ent) override;
+		void OnLeave(Entity* ent) override;
+
+	private:
+		//drops eid from the buffer when it is there, returns whether it was
+		static bool Cancel(std::vector<EntityID>& buffer, std::vector<index_t>& positions, EntityID eid);
+		static void Push(std::vector<EntityID>& buffer, std::vector<index_t>& positions, EntityID eid);
+		static void Forget(const std::vector<EntityID>& buffer, std::vector<index_t>& positions);
+	};
+
+	//Args are component types or Exclude<...> terms, like those of CachedQuery
+	template <typename... Args>
+	class ReactiveQuery : public BaseReactiveQuery
+	{
+		static_assert(details::conjunction_v<std::integral_constant<bool, details::QueryTerm<Args>::kValid>...> && (details::RequiredCount<Args...>() + details::TagCount<Args...>() > 0), "invalid argument type!");
+		static_assert(details::ChangedCount<Args...>() == 0, "Changed terms are only supported by ComponentItr!");
+	public:
+		ReactiveQuery() : BaseReactiveQuery(details::QueryMasks<Args...>::Get().required, details::QueryMasks<Args...>::Get().excluded) {}
+	};
+}
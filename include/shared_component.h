@@ -0,0 +1,181 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <utility>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+#include <type_traits>
+#include "ecs_define.h"
+#include "base_component.h"
+
+namespace ecs
+{
+	template <class T>
+	class SharedStorage;
+
+	//hash used to find equal shared values, specialize it or std::hash<T>. T also needs operator==
+	template <class T>
+	struct SharedHash
+	{
+		size_t operator()(const T& value) const { return std::hash<T>()(value); }
+	};
+
+	namespace details
+	{
+		template <class T>
+		struct SharedEntry
+		{
+			SharedEntry(T&& value, size_t hash, index_t group, SharedStorage<T>* owner)
+				: value(std::move(value)), hash(hash), group(group), owner(owner) {}
+
+			T value;
+			size_t hash;
+			std::atomic<size_t> refs{ 0 };
+			index_t group;
+			SharedStorage<T>* owner;
+		};
+	}
+
+	//a reference counted handle to an immutable value that equal components share. It is stored like
+	//any other component, entity.Add<Shared<Stats>>(args...) finds or creates the value built from args.
+	//handles can be copied and dropped on any thread, e.g. into the command buffers of parallel systems.
+	//Interning and releasing the last handle of a value happen on the updating thread.
+	template <class T>
+	class Shared
+	{
+		using Entry = details::SharedEntry<T>;
+		Entry* entry_{ nullptr };
+
+	public:
+		using ValueType = T;
+		static constexpr index_t kNoGroup = index_t(-1);
+
+		Shared() = default;
+		explicit Shared(Entry* entry) : entry_(entry) { Acquire(); }
+		Shared(const Shared& other) : entry_(other.entry_) { Acquire(); }
+		Shared(Shared&& other) : entry_(other.entry_) { other.entry_ = nullptr; }
+		Shared& operator=(Shared other)
+		{
+			std::swap(entry_, other.entry_);
+			return *this;
+		}
+		~Shared();
+
+		const T& operator*() const { return entry_->value; }
+		const T* operator->() const { return &entry_->value; }
+		const T* get() const { return entry_ ? &entry_->value : nullptr; }
+		explicit operator bool() const { return entry_ != nullptr; }
+		//dense id of the value among the live values of T, reused once the value is released
+		index_t Group() const { return entry_ ? entry_->group : kNoGroup; }
+		size_t UseCount() const { return entry_ ? entry_->refs.load(std::memory_order_relaxed) : 0; }
+
+	private:
+		void Acquire()
+		{
+			if (entry_)
+			{
+				entry_->refs.fetch_add(1, std::memory_order_relaxed);
+			}
+		}
+	};
+
+	template <class T>
+	constexpr index_t Shared<T>::kNoGroup;
+
+	template <class T>
+	struct IsShared : std::false_type {};
+	template <class T>
+	struct IsShared<Shared<T>> : std::true_type {};
+
+	class BaseSharedStorage
+	{
+	public:
+		BaseSharedStorage() = default;
+		virtual ~BaseSharedStorage() = default;
+		BaseSharedStorage(const BaseSharedStorage&) = delete;
+		BaseSharedStorage& operator=(const BaseSharedStorage&) = delete;
+	};
+
+	//the distinct live values of T, a value is destroyed when its last handle goes away
+	template <class T>
+	class SharedStorage : public BaseSharedStorage
+	{
+		using Entry = details::SharedEntry<T>;
+		std::unordered_multimap<size_t, Entry*> lookup_;
+		std::vector<index_t> free_groups_;
+		index_t group_count_{ 0 };
+
+	public:
+		~SharedStorage() override
+		{
+			for (auto& item : lookup_)
+			{
+				delete item.second;
+			}
+		}
+
+		size_t size() const { return lookup_.size(); }
+		bool empty() const { return lookup_.empty(); }
+		//upper bound of the groups of the live values
+		index_t GroupCount() const { return group_count_; }
+
+		//the handle of the value built from args, T is built like a component
+		template <typename... Args>
+		Shared<T> Intern(Args&&... args)
+		{
+			typename std::aligned_storage<sizeof(T), alignof(T)>::type buffer;
+			T* value = details::ConstructComponent<T>(&buffer, std::forward<Args>(args)...);
+			const size_t hash = SharedHash<T>()(*value);
+			auto range = lookup_.equal_range(hash);
+			for (auto it = range.first; it != range.second; ++it)
+			{
+				if (it->second->value == *value)
+				{
+					value->~T();
+					return Shared<T>(it->second);
+				}
+			}
+			index_t group = group_count_;
+			if (!free_groups_.empty())
+			{
+				group = free_groups_.back();
+				free_groups_.pop_back();
+			}
+			else
+			{
+				++group_count_;
+			}
+			Entry* entry = new Entry(std::move(*value), hash, group, this);
+			value->~T();
+			lookup_.emplace(hash, entry);
+			return Shared<T>(entry);
+		}
+		Shared<T> Intern(Shared<T> handle) { return handle; }
+
+		void Release(Entry* entry)
+		{
+			auto range = lookup_.equal_range(entry->hash);
+			for (auto it = range.first; it != range.second; ++it)
+			{
+				if (it->second == entry)
+				{
+					lookup_.erase(it);
+					break;
+				}
+			}
+			free_groups_.push_back(entry->group);
+			delete entry;
+		}
+	};
+
+	template <class T>
+	Shared<T>::~Shared()
+	{
+		if (entry_ && entry_->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			entry_->owner->Release(entry_);
+		}
+	}
+}
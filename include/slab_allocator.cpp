@@ -0,0 +1,46 @@
+#include "slab_allocator.h"
+#include "component_storage.h"
+#include <algorithm>
+
+using namespace ecs;
+
+constexpr size_t SlabAllocator::kPageBytes;
+
+SlabAllocator::SlabAllocator(size_t object_size, size_t alignment)
+	: alignment_(std::max(alignment, alignof(FreeNode)))
+{
+	//every object must be able to hold the free list link
+	stride_ = (std::max(object_size, sizeof(FreeNode)) + alignment_ - 1) & ~(alignment_ - 1);
+	objects_per_page_ = std::max<size_t>(kPageBytes / stride_, 1);
+}
+
+SlabAllocator::~SlabAllocator()
+{
+	for (char* page : pages_)
+	{
+		details::AlignedFree(page);
+	}
+}
+
+void SlabAllocator::Reserve(size_t count)
+{
+	while (stats_.capacity - stats_.live < count)
+	{
+		AddPage();
+	}
+}
+
+void SlabAllocator::AddPage()
+{
+	char* page = static_cast<char*>(details::AlignedAlloc(objects_per_page_ * stride_, std::max(alignment_, BaseComponentStorage::kCacheLineSize)));
+	pages_.push_back(page);
+	//linked back to front so the page is handed out in address order
+	for (size_t i = objects_per_page_; i-- > 0;)
+	{
+		FreeNode* node = reinterpret_cast<FreeNode*>(page + i * stride_);
+		node->next = free_list_;
+		free_list_ = node;
+	}
+	++stats_.pages;
+	stats_.capacity += objects_per_page_;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <vector>
+#include "ecs_define.h"
+
+namespace ecs
+{
+	//fixed-size objects carved out of large pages. Freed objects go to an intrusive free list and are
+	//handed out again newest first, pages are only returned when the allocator is destroyed.
+	class SlabAllocator
+	{
+	public:
+		static constexpr size_t kPageBytes = 16 * 1024;
+
+		struct Stats
+		{
+			size_t pages{ 0 };
+			//objects the pages can hold
+			size_t capacity{ 0 };
+			size_t live{ 0 };
+			size_t peak{ 0 };
+			size_t allocations{ 0 };
+			size_t frees{ 0 };
+		};
+
+	private:
+		struct FreeNode
+		{
+			FreeNode* next;
+		};
+
+		size_t stride_;
+		size_t alignment_;
+		size_t objects_per_page_;
+		std::vector<char*> pages_;
+		FreeNode* free_list_{ nullptr };
+		Stats stats_;
+
+	public:
+		SlabAllocator(size_t object_size, size_t alignment);
+		~SlabAllocator();
+		SlabAllocator(const SlabAllocator&) = delete;
+		SlabAllocator& operator=(const SlabAllocator&) = delete;
+
+		void* Allocate()
+		{
+			if (!free_list_)
+			{
+				AddPage();
+			}
+			FreeNode* node = free_list_;
+			free_list_ = node->next;
+			++stats_.allocations;
+			if (++stats_.live > stats_.peak)
+			{
+				stats_.peak = stats_.live;
+			}
+			return node;
+		}
+		void Free(void* ptr)
+		{
+			FreeNode* node = static_cast<FreeNode*>(ptr);
+			node->next = free_list_;
+			free_list_ = node;
+			++stats_.frees;
+			--stats_.live;
+		}
+		//makes room for count more objects without further page allocations
+		void Reserve(size_t count);
+
+		size_t ObjectSize() const { return stride_; }
+		const Stats& GetStats() const { return stats_; }
+
+	private:
+		void AddPage();
+	};
+}
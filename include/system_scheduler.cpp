@@ -0,0 +1,169 @@
+#include "system_scheduler.h"
+#include "base_system.h"
+#include <algorithm>
+
+using namespace ecs;
+
+namespace
+{
+	thread_local const BaseSystem* current_system = nullptr;
+
+	//a worker may run another system while it waits inside one, the outer one is restored after
+	struct CurrentSystemScope
+	{
+		const BaseSystem* previous;
+		explicit CurrentSystemScope(const BaseSystem* system) : previous(current_system) { current_system = system; }
+		~CurrentSystemScope() { current_system = previous; }
+	};
+}
+
+const BaseSystem* SystemScheduler::Current()
+{
+	return current_system;
+}
+
+void SystemScheduler::Execute(BaseSystem* system, float time_step)
+{
+	{
+		CurrentSystemScope scope(system);
+		system->Update(time_step);
+	}
+	//writes of the system carry at most this version, writes after it a newer one
+	if (clock_)
+	{
+		system->last_run_version_ = clock_->fetch_add(1);
+	}
+}
+
+void SystemScheduler::SetMode(ScheduleMode mode, size_t threads)
+{
+	mode_ = mode;
+	if (mode != ScheduleMode::kParallel)
+	{
+		pool_.reset();
+		return;
+	}
+	if (threads == 0)
+	{
+		unsigned cores = std::thread::hardware_concurrency();
+		threads = cores > 1 ? cores - 1 : 1;
+	}
+	if (!pool_ || pool_->Size() != threads)
+	{
+		pool_.reset(new WorkerPool(threads));
+	}
+}
+
+void SystemScheduler::Add(BaseSystem* system)
+{
+	systems_.push_back(system);
+	dirty_ = true;
+}
+
+void SystemScheduler::Remove(BaseSystem* system)
+{
+	systems_.erase(std::remove(systems_.begin(), systems_.end(), system), systems_.end());
+	dirty_ = true;
+}
+
+void SystemScheduler::Clear()
+{
+	systems_.clear();
+	dirty_ = true;
+}
+
+void SystemScheduler::Run(float time_step)
+{
+	if (mode_ == ScheduleMode::kSequential || systems_.size() < 2)
+	{
+		for (BaseSystem* system : systems_)
+		{
+			Execute(system, time_step);
+		}
+		return;
+	}
+	Build();
+	error_ = nullptr;
+	remaining_ = nodes_.size();
+	for (size_t i = 0; i < nodes_.size(); ++i)
+	{
+		pending_[i] = nodes_[i].dependencies;
+	}
+	for (size_t i = 0; i < nodes_.size(); ++i)
+	{
+		if (nodes_[i].dependencies == 0)
+		{
+			pool_->Submit([this, i, time_step] { RunNode(i, time_step); });
+		}
+	}
+	pool_->RunUntil([this] { return remaining_ == 0; });
+	if (error_)
+	{
+		std::rethrow_exception(error_);
+	}
+}
+
+std::vector<size_t> SystemScheduler::Dependencies(size_t position)
+{
+	Build();
+	std::vector<size_t> dependencies;
+	for (size_t i = 0; i < position; ++i)
+	{
+		const std::vector<size_t>& successors = nodes_[i].successors;
+		if (std::find(successors.begin(), successors.end(), position) != successors.end())
+		{
+			dependencies.push_back(i);
+		}
+	}
+	return dependencies;
+}
+
+void SystemScheduler::Build()
+{
+	if (!dirty_)
+	{
+		return;
+	}
+	nodes_.assign(systems_.size(), Node());
+	for (size_t later = 0; later < systems_.size(); ++later)
+	{
+		nodes_[later].system = systems_[later];
+		for (size_t earlier = 0; earlier < later; ++earlier)
+		{
+			if (systems_[earlier]->ConflictsWith(*systems_[later]))
+			{
+				nodes_[earlier].successors.push_back(later);
+				++nodes_[later].dependencies;
+			}
+		}
+	}
+	pending_.reset(new std::atomic<size_t>[nodes_.size()]);
+	dirty_ = false;
+}
+
+void SystemScheduler::RunNode(size_t index, float time_step)
+{
+	try
+	{
+		Execute(nodes_[index].system, time_step);
+	}
+	catch (...)
+	{
+		std::lock_guard<std::mutex> lock(error_mutex_);
+		if (!error_)
+		{
+			error_ = std::current_exception();
+		}
+	}
+	for (size_t successor : nodes_[index].successors)
+	{
+		if (pending_[successor].fetch_sub(1) == 1)
+		{
+			pool_->Submit([this, successor, time_step] { RunNode(successor, time_step); });
+		}
+	}
+	if (remaining_.fetch_sub(1) == 1)
+	{
+		pool_->Notify();
+	}
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "ecs_define.h"
+#include "worker_pool.h"
+
+namespace ecs
+{
+	class BaseSystem;
+
+	//runs the systems of an EntityAdmin. In parallel mode the systems form a DAG in registration order:
+	//a system waits for every earlier system it conflicts with, see BaseSystem::ConflictsWith.
+	//Systems running in parallel must not add or remove components, create or destroy entities.
+	class SystemScheduler
+	{
+	private:
+		struct Node
+		{
+			BaseSystem* system{ nullptr };
+			std::vector<size_t> successors;
+			size_t dependencies{ 0 };
+		};
+
+		ScheduleMode mode_{ ScheduleMode::kSequential };
+		//in registration order
+		std::vector<BaseSystem*> systems_;
+		std::vector<Node> nodes_;
+		bool dirty_{ true };
+
+		std::unique_ptr<WorkerPool> pool_;
+		std::unique_ptr<std::atomic<size_t>[]> pending_;
+		std::atomic<size_t> remaining_{ 0 };
+		std::mutex error_mutex_;
+		std::exception_ptr error_;
+		std::atomic<version_t>* clock_{ nullptr };
+
+	public:
+		SystemScheduler() = default;
+		SystemScheduler(const SystemScheduler&) = delete;
+		SystemScheduler& operator=(const SystemScheduler&) = delete;
+
+		//threads is the number of worker threads besides the calling one, 0 picks one per remaining core
+		void SetMode(ScheduleMode mode, size_t threads = 0);
+		ScheduleMode Mode() const { return mode_; }
+		size_t ThreadCount() const { return pool_ ? pool_->Size() : 0; }
+		//null in sequential mode
+		WorkerPool* Pool() const { return pool_.get(); }
+
+		void Add(BaseSystem* system);
+		void Remove(BaseSystem* system);
+		void Clear();
+		const std::vector<BaseSystem*>& Systems() const { return systems_; }
+
+		//runs every system once, rethrows the first exception a system threw after all of them finished
+		void Run(float time_step);
+		//the systems a system waits for in parallel mode, by registration position
+		std::vector<size_t> Dependencies(size_t position);
+
+		//the change clock of the admin, every system run ends with a new version
+		void SetClock(std::atomic<version_t>* clock) { clock_ = clock; }
+		//the system running on the calling thread, null outside of Run
+		static const BaseSystem* Current();
+
+	private:
+		void Build();
+		void Execute(BaseSystem* system, float time_step);
+		void RunNode(size_t index, float time_step);
+	};
+}
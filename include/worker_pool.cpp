@@ -0,0 +1,181 @@
+#include "worker_pool.h"
+#include <algorithm>
+#include <exception>
+
+using namespace ecs;
+
+namespace
+{
+	thread_local const WorkerPool* current_pool = nullptr;
+	thread_local size_t current_index = 0;
+}
+
+WorkerPool::WorkerPool(size_t threads)
+{
+	for (size_t i = 0; i <= threads; ++i)
+	{
+		queues_.emplace_back(new TaskQueue());
+	}
+	for (size_t i = 0; i < threads; ++i)
+	{
+		threads_.emplace_back(&WorkerPool::WorkerLoop, this, i);
+	}
+}
+
+WorkerPool::~WorkerPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stop_ = true;
+	}
+	cv_.notify_all();
+	for (std::thread& thread : threads_)
+	{
+		thread.join();
+	}
+}
+
+size_t WorkerPool::WorkerIndex() const
+{
+	return current_pool == this ? current_index : Size();
+}
+
+void WorkerPool::Submit(std::function<void()> task)
+{
+	TaskQueue& queue = *queues_[WorkerIndex()];
+	//counted before it is visible so a thief never takes queued_ below zero
+	++queued_;
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.tasks.push_back(std::move(task));
+	}
+	//sleepers test queued_ under mutex_, taking it here means the wake-up cannot be missed
+	std::lock_guard<std::mutex> lock(mutex_);
+	cv_.notify_one();
+}
+
+bool WorkerPool::TryTake(size_t index, std::function<void()>& task)
+{
+	if (queued_ == 0)
+	{
+		return false;
+	}
+	//own deque newest first, it is the warmest in cache
+	TaskQueue& own = *queues_[index];
+	{
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if (!own.tasks.empty())
+		{
+			task = std::move(own.tasks.back());
+			own.tasks.pop_back();
+			--queued_;
+			return true;
+		}
+	}
+	for (size_t offset = 1; offset < queues_.size(); ++offset)
+	{
+		TaskQueue& victim = *queues_[(index + offset) % queues_.size()];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (!victim.tasks.empty())
+		{
+			task = std::move(victim.tasks.front());
+			victim.tasks.pop_front();
+			--queued_;
+			return true;
+		}
+	}
+	return false;
+}
+
+void WorkerPool::RunUntil(const std::function<bool()>& done)
+{
+	const size_t index = WorkerIndex();
+	std::function<void()> task;
+	while (true)
+	{
+		if (TryTake(index, task))
+		{
+			task();
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(mutex_);
+		if (done())
+		{
+			return;
+		}
+		if (queued_ == 0)
+		{
+			cv_.wait(lock);
+		}
+	}
+}
+
+void WorkerPool::Notify()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	cv_.notify_all();
+}
+
+void WorkerPool::ParallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t, size_t)>& body)
+{
+	if (count == 0)
+	{
+		return;
+	}
+	grain = std::max<size_t>(grain, 1);
+	const size_t ranges = (count + grain - 1) / grain;
+	std::atomic<size_t> remaining{ ranges };
+	std::mutex error_mutex;
+	std::exception_ptr error;
+	for (size_t range = 0; range < ranges; ++range)
+	{
+		Submit([&, range] {
+			size_t begin = range * grain;
+			try
+			{
+				body(begin, std::min(count, begin + grain), WorkerIndex());
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> lock(error_mutex);
+				if (!error)
+				{
+					error = std::current_exception();
+				}
+			}
+			if (remaining.fetch_sub(1) == 1)
+			{
+				Notify();
+			}
+		});
+	}
+	RunUntil([&remaining] { return remaining == 0; });
+	if (error)
+	{
+		std::rethrow_exception(error);
+	}
+}
+
+void WorkerPool::WorkerLoop(size_t index)
+{
+	current_pool = this;
+	current_index = index;
+	std::function<void()> task;
+	while (true)
+	{
+		if (TryTake(index, task))
+		{
+			task();
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(mutex_);
+		if (stop_ && queued_ == 0)
+		{
+			return;
+		}
+		if (queued_ == 0 && !stop_)
+		{
+			cv_.wait(lock);
+		}
+	}
+}
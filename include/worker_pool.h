@@ -0,0 +1,60 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ecs
+{
+	//a fixed set of threads with one task deque each. A worker pops the newest task of its own deque
+	//and steals the oldest task of another deque when its own is empty. Tasks submitted from other
+	//threads go to a shared deque. The thread waiting in RunUntil executes tasks as well, so a pool
+	//of N threads uses N + 1 cores.
+	class WorkerPool
+	{
+	private:
+		struct TaskQueue
+		{
+			std::mutex mutex;
+			std::deque<std::function<void()>> tasks;
+		};
+
+		std::vector<std::thread> threads_;
+		//one per worker, the last one is shared by every other thread
+		std::vector<std::unique_ptr<TaskQueue>> queues_;
+		std::atomic<size_t> queued_{ 0 };
+		//only guards sleeping and waking up, the deques have their own locks
+		std::mutex mutex_;
+		std::condition_variable cv_;
+		bool stop_{ false };
+
+	public:
+		explicit WorkerPool(size_t threads);
+		~WorkerPool();
+		WorkerPool(const WorkerPool&) = delete;
+		WorkerPool& operator=(const WorkerPool&) = delete;
+
+		size_t Size() const { return threads_.size(); }
+		//index of the calling thread in [0, Size()) for workers, Size() for any other thread
+		size_t WorkerIndex() const;
+
+		void Submit(std::function<void()> task);
+		//runs tasks on the calling thread until done returns true, done is tested under the wake-up lock
+		void RunUntil(const std::function<bool()>& done);
+		//wakes the threads in RunUntil after the state tested by done changed
+		void Notify();
+
+		//calls body(begin, end, worker index) for [0, count) split into ranges of grain elements
+		//and returns once every range ran. The first exception a range threw is rethrown.
+		void ParallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t, size_t)>& body);
+
+	private:
+		void WorkerLoop(size_t index);
+		bool TryTake(size_t index, std::function<void()>& task);
+	};
+}
@@ -28,6 +28,27 @@
 
 using namespace ecs;
 
+namespace
+{
+	class HitMarkerComponent;
+	struct UnitStats
+	{
+		int hp;
+		int armor;
+		bool operator==(const UnitStats& other) const { return hp == other.hp && armor == other.armor; }
+	};
+}
+namespace ecs
+{
+	template <>
+	struct IsTransient<HitMarkerComponent> : std::true_type {};
+	template <>
+	struct SharedHash<UnitStats>
+	{
+		size_t operator()(const UnitStats& stats) const { return size_t(stats.hp) * 31 + size_t(stats.armor); }
+	};
+}
+
 namespace
 {
 	int movement_component_count;
@@ -35,6 +56,7 @@ namespace
 	{
 	public:
 		MovementComponent() { ++movement_component_count; }
+		MovementComponent(const MovementComponent& other) : BaseComponent(other), velocity(other.velocity) { ++movement_component_count; }
 		~MovementComponent() { --movement_component_count; }
 
 		void Reset(float velocity) { this->velocity = velocity; }
@@ -47,6 +69,7 @@ namespace
 	{
 	public:
 		HealthComponent() { ++health_component_count; }
+		HealthComponent(const HealthComponent& other) : BaseComponent(other), hp(other.hp), mana(other.mana) { ++health_component_count; }
 		~HealthComponent() { --health_component_count; }
 
 		void Reset(float hp, float mana)
@@ -64,6 +87,7 @@ namespace
 	{
 	public:
 		PositionComponent() { ++position_component_count; }
+		PositionComponent(const PositionComponent& other) : BaseComponent(other), x(other.x), y(other.y), z(other.z) { ++position_component_count; }
 		~PositionComponent() { --position_component_count; }
 
 		void Reset(float px, float py, float pz)
@@ -79,6 +103,84 @@ namespace
 		float z;
 	};
 
+	int hit_marker_component_count;
+	class HitMarkerComponent : public BaseComponent
+	{
+	public:
+		HitMarkerComponent() { ++hit_marker_component_count; }
+		~HitMarkerComponent() { --hit_marker_component_count; }
+
+		void Reset(float damage) { this->damage = damage; }
+		float damage;
+	};
+
+	//plain components, no vtable and no owner pointer
+	struct Transform
+	{
+		float x, y, z;
+	};
+	struct Velocity
+	{
+		Velocity() = default;
+		Velocity(float dx, float dy) : dx(dx), dy(dy) {}
+		float dx{ 0.f };
+		float dy{ 0.f };
+	};
+
+	//tags
+	struct PlayerTag {};
+	struct DeadTag {};
+
+	class UnusedComponent : public BaseComponent
+	{
+	public:
+		void Reset() {}
+	};
+
+	//singletons
+	struct FrameClock
+	{
+		float elapsed;
+		int frames;
+	};
+	int gravity_destroyed_count;
+	struct Gravity
+	{
+		explicit Gravity(float g) : g(g) {}
+		~Gravity() { ++gravity_destroyed_count; }
+		float g;
+	};
+
+	class ClockSystem : public BaseSystem
+	{
+	public:
+		ClockSystem(EntityAdmin* admin) : BaseSystem(admin) { Write<FrameClock>(); }
+		void Update(float time_step) override
+		{
+			FrameClock* clock = admin_->Singleton<FrameClock>();
+			clock->elapsed += time_step;
+			clock->frames++;
+		}
+	};
+	class FallSystem : public BaseSystem
+	{
+	public:
+		FallSystem(EntityAdmin* admin) : BaseSystem(admin)
+		{
+			Read<Gravity, FrameClock>();
+			Write<PositionComponent>();
+		}
+		void Update(float time_step) override
+		{
+			const float g = admin_->Singleton<Gravity>()->g;
+			last_frame = admin_->Singleton<FrameClock>()->frames;
+			for (PositionComponent* p : ComponentItr<PositionComponent>(admin_)) {
+				p->y -= g * time_step;
+			}
+		}
+		int last_frame{ 0 };
+	};
+
 	int demo_system_movement_update_times;
 	int demo_system_position_update_times;
 	int demo_system_health_update_times;
@@ -103,6 +205,108 @@ namespace
 			}
 		}
 	};
+
+	class MoveSystem : public BaseSystem
+	{
+	public:
+		MoveSystem(EntityAdmin* admin) : BaseSystem(admin)
+		{
+			Read<MovementComponent>();
+			Write<PositionComponent>();
+		}
+		void Update(float time_step) override
+		{
+			for (auto&& t : ComponentItr<MovementComponent, PositionComponent>(admin_)) {
+				std::get<1>(t)->x += std::get<0>(t)->velocity * time_step;
+			}
+		}
+	};
+	class RegenSystem : public BaseSystem
+	{
+	public:
+		RegenSystem(EntityAdmin* admin) : BaseSystem(admin) { Write<HealthComponent>(); }
+		void Update(float) override
+		{
+			for (HealthComponent* h : ComponentItr<HealthComponent>(admin_)) {
+				h->hp += 1.f;
+			}
+		}
+	};
+	class HealthReportSystem : public BaseSystem
+	{
+	public:
+		HealthReportSystem(EntityAdmin* admin) : BaseSystem(admin) { Read<HealthComponent>(); }
+		void Update(float) override
+		{
+			total_hp = 0.f;
+			for (HealthComponent* h : ComponentItr<HealthComponent>(admin_)) {
+				total_hp += h->hp;
+			}
+		}
+		float total_hp{ 0.f };
+	};
+
+	//change detection
+	class MarchSystem : public BaseSystem
+	{
+	public:
+		MarchSystem(EntityAdmin* admin) : BaseSystem(admin)
+		{
+			Read<Velocity>();
+			Write<Transform>();
+		}
+		void Update(float time_step) override
+		{
+			for (auto&& t : ComponentItr<Mut<Transform>, Velocity>(admin_)) {
+				std::get<0>(t)->x += std::get<1>(t)->dx * time_step;
+			}
+		}
+	};
+	class MovedReportSystem : public BaseSystem
+	{
+	public:
+		MovedReportSystem(EntityAdmin* admin) : BaseSystem(admin) { Read<Transform>(); }
+		void Update(float) override
+		{
+			moved = 0;
+			for (Transform* t : ComponentItr<Changed<Transform>>(admin_)) {
+				(void)t;
+				moved++;
+			}
+		}
+		int moved{ 0 };
+	};
+
+	//transient components
+	class HitReportSystem : public BaseSystem
+	{
+	public:
+		HitReportSystem(EntityAdmin* admin) : BaseSystem(admin) { Read<HitMarkerComponent>(); }
+		void Update(float) override
+		{
+			seen = admin_->GetAllComponents<HitMarkerComponent>().size();
+		}
+		size_t seen{ 0 };
+	};
+	class HitSystem : public BaseSystem
+	{
+	public:
+		HitSystem(EntityAdmin* admin) : BaseSystem(admin) { Write<HitMarkerComponent>(); }
+		void Update(float) override
+		{
+			for (EntityID id : targets) {
+				if (deferred) {
+					admin_->Commands().Add<HitMarkerComponent>(id, 1.f);
+				}
+				else {
+					admin_->FindEntity(id)->Add<HitMarkerComponent>(1.f);
+				}
+			}
+			targets.clear();
+		}
+		std::vector<EntityID> targets;
+		bool deferred{ true };
+	};
 }
 
 SCENARIO("Testing ecs framework, unittests") {
@@ -133,6 +337,10 @@ SCENARIO("Testing ecs framework, unittests") {
 					REQUIRE(!has_movement);
 					REQUIRE(!has_position_and_movement);
 				}
+				THEN("Its signature has exactly the attached components") {
+					REQUIRE(entity.Signature() == (details::ComponentMaskOf<PositionComponent, HealthComponent>()));
+					REQUIRE(entity.Signature().count() == 2);
+				}
 				THEN("Accessing added components should work") {
 					entity.Get<PositionComponent>();
 					entity.Get<HealthComponent>();
@@ -254,6 +462,46 @@ SCENARIO("Testing ecs framework, unittests") {
 					}
 					REQUIRE(count == 2);
 				}
+				THEN("Iterating with compile-time predicates") {
+					int count = 0;
+					for (MovementComponent* m : MakeComponentItr<MovementComponent>(&admin)) {
+						REQUIRE(m != nullptr);
+						count++;
+					}
+					REQUIRE(count == 3);
+					count = 0;
+					float min_velocity = 40.f;
+					for (auto&& t : MakeComponentItr<MovementComponent, HealthComponent>(&admin,
+						[min_velocity](const MovementComponent* m, const HealthComponent*) { return m->velocity > min_velocity; })) {
+						REQUIRE(std::get<1>(t)->hp == 40.f);
+						count++;
+					}
+					REQUIRE(count == 1);
+				}
+				THEN("Iterating with Exclude and Optional terms") {
+					int count = 0;
+					for (MovementComponent* m : ComponentItr<MovementComponent, Exclude<HealthComponent>>(&admin)) {
+						REQUIRE(m->velocity == 22.f);
+						count++;
+					}
+					REQUIRE(count == 1);
+					count = 0;
+					int without_health = 0;
+					for (auto&& t : ComponentItr<MovementComponent, Optional<HealthComponent>>(&admin)) {
+						REQUIRE(std::get<0>(t) != nullptr);
+						without_health += std::get<1>(t) ? 0 : 1;
+						count++;
+					}
+					REQUIRE(count == 3);
+					REQUIRE(without_health == 1);
+					count = 0;
+					for (auto&& t : MakeComponentItr<MovementComponent, Exclude<PositionComponent, UnusedComponent>, HealthComponent>(&admin,
+						[](const MovementComponent*, const HealthComponent* h) { return h->hp > 0.f; })) {
+						REQUIRE(std::get<1>(t)->hp == 30.f);
+						count++;
+					}
+					REQUIRE(count == 1);
+				}
 				THEN("Iterating MovementComponent And HealthComponent") {
 					int count = 0;
 					for (std::tuple<MovementComponent*, HealthComponent*>&& t : ComponentItr<MovementComponent, HealthComponent>(&admin)) {
@@ -283,6 +531,740 @@ SCENARIO("Testing ecs framework, unittests") {
 					}
 					REQUIRE(count == 0);
 				}
+				AND_WHEN("Registering a cached query") {
+					CachedQuery<MovementComponent, HealthComponent>& query = admin.Query<MovementComponent, HealthComponent>();
+					THEN("It holds the entities that already match") {
+						REQUIRE(query.size() == 2);
+						REQUIRE((&admin.Query<MovementComponent, HealthComponent>() == &query));
+						int count = 0;
+						for (std::tuple<MovementComponent*, HealthComponent*>&& t : query) {
+							REQUIRE(std::get<0>(t)->Owner() == std::get<1>(t)->Owner());
+							count++;
+						}
+						REQUIRE(count == 2);
+					}
+					THEN("It follows added, removed and destroyed components") {
+						entity2.Add<HealthComponent>(20.f, 40.f);
+						REQUIRE(query.Contains(&entity2));
+						entity3.Remove<HealthComponent>();
+						REQUIRE(!query.Contains(&entity3));
+						admin.DestroyEntity(entity4.GetEntityID());
+						REQUIRE(query.size() == 1);
+						float hp = 0.f;
+						query.ForEach([&hp](MovementComponent*, HealthComponent* h) { hp += h->hp; });
+						REQUIRE(hp == 20.f);
+					}
+				}
+				AND_WHEN("Registering a cached query with an excluded component") {
+					CachedQuery<MovementComponent, Exclude<PositionComponent>>& query = admin.Query<MovementComponent, Exclude<PositionComponent>>();
+					THEN("Adding the excluded component drops the entity") {
+						REQUIRE(query.size() == 2);
+						entity2.Add<PositionComponent>(1.f, 2.f, 3.f);
+						REQUIRE(!query.Contains(&entity2));
+						entity4.Remove<PositionComponent>();
+						REQUIRE(query.Contains(&entity4));
+						float velocity = 0.f;
+						query.ForEach([&velocity](MovementComponent* m) { velocity += m->velocity; });
+						REQUIRE(velocity == 77.f);
+					}
+				}
+				AND_WHEN("Recording commands while iterating") {
+					CommandBuffer& commands = admin.Commands();
+					for (MovementComponent* m : ComponentItr<MovementComponent>(&admin)) {
+						if (m->velocity > 30.f) {
+							commands.Remove<MovementComponent>(m->Owner()->GetEntityID());
+						}
+						commands.Add<HealthComponent>(m->Owner()->GetEntityID(), m->velocity, 0.f);
+					}
+					commands.Destroy(entity1.GetEntityID());
+					commands.Destroy(entity1.GetEntityID());
+					DeferredEntity spawned = commands.Create();
+					commands.Add<PositionComponent>(spawned, 7.f, 8.f, 9.f);
+					commands.Add<MovementComponent>(spawned, 5.f);
+					THEN("Nothing changes before playback") {
+						REQUIRE(commands.size() == 10);
+						REQUIRE(movement_component_count == 3);
+						REQUIRE(admin.EntityCount() == 4);
+					}
+					THEN("Playback applies them in one batch") {
+						EntityID destroyed = entity1.GetEntityID();
+						admin.PlaybackCommands();
+						REQUIRE(commands.empty());
+						REQUIRE(admin.EntityCount() == 4);
+						REQUIRE(!admin.IsAlive(destroyed));
+						REQUIRE(movement_component_count == 2);
+						REQUIRE(!entity3.Has<MovementComponent>());
+						REQUIRE(entity2.Get<HealthComponent>()->hp == 22.f);
+						REQUIRE(entity4.Get<HealthComponent>()->hp == 44.f);
+						int count = 0;
+						for (auto&& t : ComponentItr<MovementComponent, PositionComponent>(&admin)) {
+							count += std::get<1>(t)->z == 9.f ? 1 : 0;
+						}
+						REQUIRE(count == 1);
+					}
+				}
+				AND_WHEN("Recording several changes of one component on one entity") {
+					CommandBuffer& commands = admin.Commands();
+					commands.Add<HealthComponent>(entity1.GetEntityID(), 1.f, 0.f);
+					commands.Remove<HealthComponent>(entity1.GetEntityID());
+					commands.Remove<MovementComponent>(entity2.GetEntityID());
+					commands.Add<MovementComponent>(entity2.GetEntityID(), 5.f);
+					commands.Remove<MovementComponent>(entity2.GetEntityID());
+					commands.Remove<MovementComponent>(entity3.GetEntityID());
+					commands.Add<MovementComponent>(entity3.GetEntityID(), 6.f);
+					commands.Add<MovementComponent>(entity3.GetEntityID(), 7.f);
+					THEN("The last recorded one decides") {
+						admin.PlaybackCommands();
+						REQUIRE(!entity1.Has<HealthComponent>());
+						REQUIRE(!entity2.Has<MovementComponent>());
+						REQUIRE(entity3.Get<MovementComponent>()->velocity == 7.f);
+						REQUIRE(entity4.Get<MovementComponent>()->velocity == 44.f);
+					}
+				}
+				AND_WHEN("Removing a MovementComponent in the middle of the storage") {
+					entity2.Remove<MovementComponent>();
+					THEN("Other entities still see their own components") {
+						REQUIRE(entity3.Get<MovementComponent>()->velocity == 33.f);
+						REQUIRE(entity4.Get<MovementComponent>()->velocity == 44.f);
+						REQUIRE(entity4.Get<MovementComponent>()->Owner() == &entity4);
+						REQUIRE(entity4.Get<MovementComponent>()->Sibling<PositionComponent>()->x == 4.f);
+					}
+					THEN("Iterating MovementComponent visits the remaining ones") {
+						float sum = 0.f;
+						for (MovementComponent* m : ComponentItr<MovementComponent>(&admin)) {
+							sum += m->velocity;
+						}
+						REQUIRE(sum == 77.f);
+					}
+					THEN("The storage maps entities to their dense slots") {
+						ComponentStorage<MovementComponent>& storage = admin.GetAllComponents<MovementComponent>();
+						REQUIRE(storage.size() == 2);
+						REQUIRE(!storage.Contains(&entity2));
+						REQUIRE(storage.Find(&entity3) == entity3.Get<MovementComponent>());
+						REQUIRE(storage.Find(&entity4) == entity4.Get<MovementComponent>());
+						REQUIRE(storage.Owner(storage.IndexOf(&entity4)) == &entity4);
+					}
+				}
+			}
+		}
+
+		GIVEN("A component type that was never registered") {
+			Entity& entity = admin.CreateEntity<Entity>();
+			entity.Add<MovementComponent>(1.f);
+			THEN("Querying it finds nothing and creates no storage") {
+				int count = 0;
+				for (auto&& t : ComponentItr<MovementComponent, UnusedComponent>(&admin)) {
+					(void)t;
+					count++;
+				}
+				REQUIRE(count == 0);
+				REQUIRE(admin.FindComponents(details::ComponentIndex::index<UnusedComponent>()) == nullptr);
+			}
+			WHEN("Registering it with a reservation") {
+				admin.RegisterComponent<UnusedComponent>(1000);
+				THEN("Its storage exists up front") {
+					BaseComponentStorage* storage = admin.FindComponents(details::ComponentIndex::index<UnusedComponent>());
+					REQUIRE(storage != nullptr);
+					REQUIRE(storage->empty());
+					REQUIRE(storage->BlockCount() == 0);
+				}
+			}
+		}
+
+		GIVEN("A wave of entities created in bulk") {
+			CachedQuery<MovementComponent, PositionComponent>& query = admin.Query<MovementComponent, PositionComponent>();
+			std::vector<EntityID> ids = admin.CreateEntities<MovementComponent, PositionComponent>(5000,
+				[](size_t i, MovementComponent* m, PositionComponent* p) {
+					m->velocity = float(i);
+					p->Reset(0.f, 0.f, 0.f);
+				});
+			THEN("Every entity owns initialized components") {
+				REQUIRE(ids.size() == 5000);
+				REQUIRE(admin.EntityCount() == 5000);
+				REQUIRE(movement_component_count == 5000);
+				REQUIRE(query.size() == 5000);
+				Entity* last = admin.FindEntity(ids.back());
+				REQUIRE(last->Get<MovementComponent>()->velocity == 4999.f);
+				REQUIRE(last->Get<PositionComponent>()->Owner() == last);
+			}
+		}
+
+		GIVEN("Entities torn down in bulk") {
+			std::vector<EntityID> ids = admin.CreateEntities<MovementComponent, PositionComponent>(100,
+				[](size_t i, MovementComponent* m, PositionComponent* p) {
+					m->velocity = float(i);
+					p->Reset(float(i), 0.f, 0.f);
+				});
+			CachedQuery<MovementComponent>& query = admin.Query<MovementComponent>();
+			WHEN("Destroying half of them at once") {
+				std::vector<EntityID> doomed;
+				for (size_t i = 0; i < ids.size(); i += 2) {
+					doomed.push_back(ids[i]);
+				}
+				doomed.push_back(ids[0]);
+				admin.DestroyEntities(doomed);
+				THEN("The survivors keep their components in order") {
+					REQUIRE(admin.EntityCount() == 50);
+					REQUIRE(movement_component_count == 50);
+					REQUIRE(position_component_count == 50);
+					REQUIRE(query.size() == 50);
+					REQUIRE(!admin.IsAlive(ids[0]));
+					Entity* survivor = admin.FindEntity(ids[51]);
+					REQUIRE(survivor->Get<MovementComponent>()->velocity == 51.f);
+					REQUIRE(survivor->Get<PositionComponent>()->x == 51.f);
+					REQUIRE(admin.GetAllComponents<MovementComponent>().Owner(0) == admin.FindEntity(ids[1]));
+					REQUIRE(admin.GetAllComponents<MovementComponent>().Owner(49) == admin.FindEntity(ids[99]));
+				}
+			}
+			WHEN("Removing one component type from everyone") {
+				admin.RemoveAll<MovementComponent>();
+				THEN("Its storage is empty and the entities live on") {
+					REQUIRE(movement_component_count == 0);
+					REQUIRE(admin.GetAllComponents<MovementComponent>().empty());
+					REQUIRE(query.empty());
+					REQUIRE(!admin.FindEntity(ids[5])->Has<MovementComponent>());
+					REQUIRE(admin.FindEntity(ids[5])->Get<PositionComponent>()->x == 5.f);
+					admin.FindEntity(ids[5])->Add<MovementComponent>(1.f);
+					REQUIRE(query.size() == 1);
+				}
+			}
+		}
+
+		GIVEN("An entity that was destroyed") {
+			Entity& entity = admin.CreateEntity<Entity>();
+			EntityID old_id = entity.GetEntityID();
+			admin.DestroyEntity(old_id);
+			Entity& recycled = admin.CreateEntity<Entity>();
+			THEN("Its slot waits until enough slots are free") {
+				REQUIRE(EntityIndex(recycled.GetEntityID()) != EntityIndex(old_id));
+				std::vector<EntityID> spare = admin.CreateEntities<MovementComponent>(ECS_MIN_FREE_ENTITY_SLOTS);
+				admin.DestroyEntities(spare);
+				Entity& reused = admin.CreateEntity<Entity>();
+				REQUIRE(EntityIndex(reused.GetEntityID()) == EntityIndex(old_id));
+				REQUIRE(EntityGeneration(reused.GetEntityID()) != EntityGeneration(old_id));
+				REQUIRE(admin.FindEntity(reused.GetEntityID()) == &reused);
+				REQUIRE(admin.EntityCount() == 2);
+			}
+			THEN("The stale id still fails after many entities came and went") {
+				admin.DestroyEntity(recycled.GetEntityID());
+				int resolved = 0;
+				for (int i = 0; i < 4096; ++i) {
+					admin.DestroyEntity(admin.CreateEntity<Entity>().GetEntityID());
+					resolved += admin.IsAlive(old_id) ? 1 : 0;
+				}
+				REQUIRE(resolved == 0);
+			}
+			THEN("The stale id does not resolve") {
+				REQUIRE(admin.FindEntity(old_id) == nullptr);
+				REQUIRE(!admin.IsAlive(old_id));
+				admin.DestroyEntity(old_id);
+				REQUIRE(admin.IsAlive(recycled.GetEntityID()));
+			}
+		}
+
+		GIVEN("Entities created and destroyed every frame") {
+			for (int frame = 0; frame < 10; ++frame) {
+				std::vector<EntityID> ids = admin.CreateEntities<MovementComponent>(1000);
+				admin.DestroyEntities(ids);
+			}
+			THEN("Their memory is recycled from the slab pages") {
+				const SlabAllocator::Stats& stats = admin.EntityAllocatorStats();
+				REQUIRE(stats.live == 0);
+				REQUIRE(stats.peak == 1000);
+				REQUIRE(stats.allocations == 10000);
+				REQUIRE(stats.frees == 10000);
+				REQUIRE(stats.capacity >= 1000);
+				REQUIRE(stats.capacity < 2000);
+			}
+		}
+
+		GIVEN("Component types with their own memory resources") {
+			PoolResource pool;
+			ArenaResource arena;
+			{
+				EntityAdmin local;
+				local.RegisterComponent<HealthComponent>(0, &pool);
+				local.RegisterComponent<PositionComponent>(0, &arena);
+				local.CreateEntities<HealthComponent, PositionComponent>(2000);
+				size_t upstream = pool.UpstreamAllocations();
+				THEN("Blocks come from the chosen resources") {
+					REQUIRE(upstream == local.GetAllComponents<HealthComponent>().BlockCount());
+					REQUIRE(local.GetAllComponents<PositionComponent>().Resource() == &arena);
+					REQUIRE(arena.Used() >= 2000 * sizeof(PositionComponent));
+					REQUIRE(local.GetAllComponents<MovementComponent>().Resource() == DefaultResource());
+				}
+				THEN("Released blocks are reused by the pool") {
+					local.RemoveAll<HealthComponent>();
+					local.GetAllComponents<HealthComponent>().ShrinkToFit();
+					REQUIRE(pool.Cached() == upstream);
+					local.CreateEntities<HealthComponent>(2000);
+					REQUIRE(pool.UpstreamAllocations() == upstream);
+					REQUIRE(pool.Cached() == 0);
+				}
+			}
+		}
+
+		GIVEN("Plain struct components") {
+			std::vector<EntityID> ids;
+			for (int i = 0; i < 5; ++i) {
+				Entity& ent = admin.CreateEntity<Entity>();
+				ent.Add<Transform>(float(i), 0.f, 0.f).Add<MovementComponent>(float(i));
+				if (i % 2 == 0) {
+					ent.Add<Velocity>(1.f, 2.f);
+				}
+				ids.push_back(ent.GetEntityID());
+			}
+			THEN("They are stored without any overhead") {
+				REQUIRE(sizeof(Transform) == 3 * sizeof(float));
+				REQUIRE(std::is_trivially_copyable<Transform>::value);
+				REQUIRE(admin.FindEntity(ids[3])->Get<Transform>()->x == 3.f);
+				REQUIRE(admin.FindEntity(ids[2])->Get<Velocity>()->dy == 2.f);
+				REQUIRE(admin.FindEntity(ids[2])->Get<MovementComponent>()->Sibling<Transform>()->x == 2.f);
+				REQUIRE(admin.GetAllComponents<Transform>().Owner(4) == admin.FindEntity(ids[4]));
+			}
+			THEN("Queries mix them with BaseComponent types") {
+				float sum = 0.f;
+				for (auto&& t : ComponentItr<Transform, Velocity, MovementComponent>(&admin)) {
+					sum += std::get<0>(t)->x + std::get<1>(t)->dx + std::get<2>(t)->velocity;
+				}
+				REQUIRE(sum == 2.f * (0.f + 2.f + 4.f) + 3.f);
+			}
+			WHEN("Removing and replacing them") {
+				admin.FindEntity(ids[1])->Remove<Transform>();
+				admin.FindEntity(ids[0])->Replace<Velocity>(5.f, 6.f);
+				THEN("The last one is relocated into the hole") {
+					ComponentStorage<Transform>& transforms = admin.GetAllComponents<Transform>();
+					REQUIRE(transforms.size() == 4);
+					REQUIRE(transforms.Owner(1) == admin.FindEntity(ids[4]));
+					REQUIRE(transforms.At(1)->x == 4.f);
+					REQUIRE(admin.FindEntity(ids[4])->Get<Transform>() == transforms.At(1));
+					REQUIRE(admin.FindEntity(ids[0])->Get<Velocity>()->dx == 5.f);
+				}
+			}
+			WHEN("Creating them in bulk") {
+				std::vector<EntityID> bulk = admin.CreateEntities<Transform, Velocity>(100);
+				THEN("They are value initialized") {
+					REQUIRE(admin.FindEntity(bulk[50])->Get<Transform>()->y == 0.f);
+					REQUIRE(admin.GetAllComponents<Velocity>().size() == 103);
+					admin.DestroyEntities(bulk);
+					REQUIRE(admin.GetAllComponents<Transform>().size() == 5);
+				}
+			}
+		}
+
+		GIVEN("Tag components") {
+			std::vector<EntityID> ids = admin.CreateEntities<MovementComponent>(6,
+				[](size_t i, MovementComponent* m) { m->velocity = float(i); });
+			for (size_t i = 0; i < ids.size(); ++i) {
+				Entity* ent = admin.FindEntity(ids[i]);
+				if (i < 3) {
+					ent->Add<PlayerTag>();
+				}
+				if (i % 2 == 1) {
+					ent->Add<DeadTag>();
+				}
+			}
+			CachedQuery<DeadTag>& dead = admin.Query<DeadTag>();
+			THEN("They live in the signature only") {
+				REQUIRE(admin.FindComponents(details::ComponentIndex::index<PlayerTag>()) == nullptr);
+				REQUIRE(admin.FindEntity(ids[0])->Has<PlayerTag>());
+				REQUIRE(admin.FindEntity(ids[0])->Get<PlayerTag>() != nullptr);
+				REQUIRE(admin.FindEntity(ids[4])->Get<PlayerTag>() == nullptr);
+				REQUIRE(dead.size() == 3);
+			}
+			THEN("Queries filter on them without yielding them") {
+				float sum = 0.f;
+				for (MovementComponent* m : ComponentItr<MovementComponent, PlayerTag, Exclude<DeadTag>>(&admin)) {
+					sum += m->velocity;
+				}
+				REQUIRE(sum == 0.f + 2.f);
+				int count = 0;
+				for (auto&& t : ComponentItr<MovementComponent, Optional<DeadTag>>(&admin)) {
+					count += std::get<1>(t) ? 1 : 0;
+				}
+				REQUIRE(count == 3);
+			}
+			WHEN("Removing them") {
+				admin.FindEntity(ids[1])->Remove<DeadTag>();
+				admin.Commands().Remove<DeadTag>(ids[3]);
+				admin.Commands().Add<DeadTag>(ids[0]);
+				admin.PlaybackCommands();
+				THEN("The queries follow") {
+					REQUIRE(dead.size() == 2);
+					REQUIRE(admin.FindEntity(ids[0])->Has<DeadTag>());
+					admin.RemoveAll<PlayerTag>();
+					REQUIRE(!admin.FindEntity(ids[2])->Has<PlayerTag>());
+					admin.DestroyEntities(std::vector<EntityID>{ ids[0], ids[5] });
+					REQUIRE(dead.empty());
+					REQUIRE(admin.GetAllComponents<MovementComponent>().size() == 4);
+				}
+			}
+		}
+
+		GIVEN("Shared components") {
+			Shared<UnitStats> elite = admin.MakeShared<UnitStats>(200, 5);
+			std::vector<EntityID> ids;
+			for (int i = 0; i < 9; ++i) {
+				Entity& ent = admin.CreateEntity<Entity>();
+				ent.Add<PositionComponent>(float(i), 0.f, 0.f);
+				if (i % 3 == 0) {
+					ent.Add<Shared<UnitStats>>(elite);
+				}
+				else {
+					ent.Add<Shared<UnitStats>>(100, i % 3);
+				}
+				ids.push_back(ent.GetEntityID());
+			}
+			THEN("Equal values are stored once") {
+				REQUIRE(admin.GetSharedValues<UnitStats>().size() == 3);
+				REQUIRE(elite.UseCount() == 4);
+				const Shared<UnitStats>& a = *admin.FindEntity(ids[1])->Get<Shared<UnitStats>>();
+				const Shared<UnitStats>& b = *admin.FindEntity(ids[4])->Get<Shared<UnitStats>>();
+				REQUIRE(a.get() == b.get());
+				REQUIRE(a->armor == 1);
+				REQUIRE(admin.FindEntity(ids[3])->Get<Shared<UnitStats>>()->get() == elite.get());
+			}
+			THEN("A value is released with its last reference") {
+				admin.FindEntity(ids[2])->Remove<Shared<UnitStats>>();
+				admin.DestroyEntity(ids[5]);
+				admin.FindEntity(ids[8])->Replace<Shared<UnitStats>>(elite);
+				REQUIRE(admin.GetSharedValues<UnitStats>().size() == 2);
+				REQUIRE(elite.UseCount() == 5);
+				admin.FindEntity(ids[1])->Replace<Shared<UnitStats>>(100, 2);
+				REQUIRE(admin.GetSharedValues<UnitStats>().size() == 3);
+			}
+			THEN("Handles can be recorded from worker threads") {
+				admin.SetScheduleMode(ScheduleMode::kParallel, 3);
+				admin.CreateEntities<PositionComponent>(991);
+				admin.Query<PositionComponent>().ParallelForEach(admin.Workers(), [&admin, &elite](PositionComponent* p) {
+					admin.Commands().Add<Shared<UnitStats>>(p->Owner()->GetEntityID(), elite);
+				}, 16);
+				REQUIRE(elite.UseCount() == 4 + 1000);
+				admin.Update(0.f);
+				REQUIRE(elite.UseCount() == 1001);
+				REQUIRE(admin.GetSharedValues<UnitStats>().size() == 1);
+			}
+			THEN("Iteration can be grouped by value") {
+				CachedQuery<Shared<UnitStats>, PositionComponent>& query = admin.Query<Shared<UnitStats>, PositionComponent>();
+				std::vector<int> armors;
+				float x = 0.f;
+				int visited = 0;
+				query.ForEachGroup<UnitStats>([&armors](const UnitStats& stats) { armors.push_back(stats.armor); },
+					[&armors, &x, &visited](Shared<UnitStats>* stats, PositionComponent* p) {
+						REQUIRE((*stats)->armor == armors.back());
+						x += p->x;
+						visited++;
+					});
+				REQUIRE(armors.size() == 3);
+				REQUIRE(visited == 9);
+				REQUIRE(x == 36.f);
+			}
+		}
+
+		GIVEN("A transient component added during a frame") {
+			hit_marker_component_count = 0;
+			std::vector<EntityID> ids = admin.CreateEntities<PositionComponent>(10);
+			for (EntityID id : ids) {
+				admin.FindEntity(id)->Add<HitMarkerComponent>(5.f);
+			}
+			CachedQuery<HitMarkerComponent>& query = admin.Query<HitMarkerComponent>();
+			void* scratch = admin.FrameArena().Allocate(256, 16);
+			THEN("Its storage is backed by the frame arena") {
+				REQUIRE(scratch != nullptr);
+				REQUIRE(admin.GetAllComponents<HitMarkerComponent>().Resource() == &admin.FrameArena());
+				REQUIRE(query.size() == 10);
+			}
+			WHEN("Updating") {
+				admin.Commands().Add<HitMarkerComponent>(ids[3], 1.f);
+				admin.Update(0.f);
+				THEN("Only the markers recorded for playback survive") {
+					REQUIRE(hit_marker_component_count == 1);
+					REQUIRE(query.size() == 1);
+					REQUIRE(admin.FindEntity(ids[3])->Get<HitMarkerComponent>()->damage == 1.f);
+					REQUIRE(!admin.FindEntity(ids[4])->Has<HitMarkerComponent>());
+					REQUIRE(admin.FindEntity(ids[4])->Has<PositionComponent>());
+					admin.Update(0.f);
+					REQUIRE(hit_marker_component_count == 0);
+					REQUIRE(query.empty());
+					REQUIRE(admin.FrameArena().Used() == 0);
+				}
+			}
+			WHEN("A system adds markers that a system before it reads") {
+				HitReportSystem& report = admin.CreateSystem<HitReportSystem>();
+				HitSystem& hit = admin.CreateSystem<HitSystem>();
+				THEN("Only the markers added through Commands reach it, in the next frame") {
+					hit.targets.push_back(ids[1]);
+					admin.Update(0.f);
+					REQUIRE(report.seen == 10);
+					REQUIRE(admin.FindEntity(ids[1])->Has<HitMarkerComponent>());
+					hit.targets.push_back(ids[2]);
+					hit.deferred = false;
+					admin.Update(0.f);
+					REQUIRE(report.seen == 1);
+					REQUIRE(hit_marker_component_count == 0);
+					admin.Update(0.f);
+					REQUIRE(report.seen == 0);
+				}
+			}
+		}
+
+		GIVEN("Singletons") {
+			gravity_destroyed_count = 0;
+			admin.SetSingleton<FrameClock>(0.f, 0);
+			admin.SetSingleton<Gravity>(10.f);
+			ClockSystem& clock = admin.CreateSystem<ClockSystem>();
+			FallSystem& fall = admin.CreateSystem<FallSystem>();
+			admin.CreateEntity<Entity>().Add<PositionComponent>(0.f, 0.f, 0.f);
+			THEN("Systems see them and are ordered by their declared access") {
+				REQUIRE(clock.ConflictsWith(fall));
+				REQUIRE((admin.Scheduler().Dependencies(1) == std::vector<size_t>{ 0 }));
+				admin.SetScheduleMode(ScheduleMode::kParallel, 2);
+				admin.Update(0.5f);
+				admin.Update(0.5f);
+				REQUIRE(admin.Singleton<FrameClock>()->frames == 2);
+				REQUIRE(admin.Singleton<FrameClock>()->elapsed == 1.f);
+				REQUIRE(fall.last_frame == 2);
+				for (PositionComponent* p : ComponentItr<PositionComponent>(&admin)) {
+					REQUIRE(p->y == -10.f);
+				}
+			}
+			THEN("Setting one again replaces it and removing it destroys it") {
+				REQUIRE(admin.SetSingleton<Gravity>(3.f).g == 3.f);
+				REQUIRE(gravity_destroyed_count == 1);
+				REQUIRE(admin.Singleton<Gravity>()->g == 3.f);
+				admin.RemoveSingleton<Gravity>();
+				REQUIRE(gravity_destroyed_count == 2);
+				REQUIRE(admin.Singleton<Gravity>() == nullptr);
+				REQUIRE(admin.Singleton<UnusedComponent>() == nullptr);
+			}
+		}
+
+		GIVEN("Component observers") {
+			std::vector<float> added;
+			std::vector<float> removed;
+			std::vector<float> replaced;
+			int tags_added = 0;
+			admin.OnAdd<PositionComponent>([&added](Entity& e, PositionComponent* p) {
+				REQUIRE(e.Get<PositionComponent>() == p);
+				added.push_back(p->x);
+			});
+			ObserverID on_remove = admin.OnRemove<PositionComponent>([&removed](Entity& e, PositionComponent* p) {
+				REQUIRE(e.Has<PositionComponent>());
+				removed.push_back(p->x);
+			});
+			admin.OnReplace<PositionComponent>([&replaced](Entity&, PositionComponent* p) { replaced.push_back(p->x); });
+			admin.OnAdd<PlayerTag>([&tags_added](Entity&, PlayerTag* tag) {
+				REQUIRE(tag == nullptr);
+				tags_added++;
+			});
+			Entity& e1 = admin.CreateEntity<Entity>();
+			Entity& e2 = admin.CreateEntity<Entity>();
+			e1.Add<PositionComponent>(1.f, 0.f, 0.f).Add<PlayerTag>();
+			e2.Add<PositionComponent>(2.f, 0.f, 0.f).Add<HealthComponent>(1.f, 1.f);
+			THEN("Immediate observers run inside every change") {
+				REQUIRE((added == std::vector<float>{ 1.f, 2.f }));
+				REQUIRE(tags_added == 1);
+				e1.Replace<PositionComponent>(3.f, 0.f, 0.f);
+				REQUIRE((replaced == std::vector<float>{ 3.f }));
+				e1.Remove<PositionComponent>();
+				admin.DestroyEntity(e2.GetEntityID());
+				REQUIRE((removed == std::vector<float>{ 3.f, 2.f }));
+				admin.Unobserve(on_remove);
+				admin.CreateEntity<Entity>().Add<PositionComponent>(4.f, 0.f, 0.f);
+				admin.RemoveAll<PositionComponent>();
+				REQUIRE(removed.size() == 2);
+			}
+			THEN("Bulk changes and command buffers notify as well") {
+				admin.CreateEntities<PositionComponent>(2, [](size_t i, PositionComponent* p) { p->x = 10.f + i; });
+				REQUIRE((added == std::vector<float>{ 1.f, 2.f, 10.f, 11.f }));
+				admin.Commands().Add<PositionComponent>(e1.GetEntityID(), 5.f, 0.f, 0.f);
+				admin.Commands().Add<PositionComponent>(admin.Commands().Create(), 6.f, 0.f, 0.f);
+				admin.PlaybackCommands();
+				REQUIRE((replaced == std::vector<float>{ 5.f }));
+				REQUIRE(added.back() == 6.f);
+				const EntityID ids[] = { e1.GetEntityID(), e2.GetEntityID() };
+				admin.DestroyEntities(ids, 2);
+				REQUIRE((removed == std::vector<float>{ 5.f, 2.f }));
+			}
+			THEN("An observer can destroy the entity whose component is removed") {
+				int health_removed = 0;
+				admin.OnRemove<HealthComponent>([&admin, &health_removed](Entity& e, HealthComponent* h) {
+					REQUIRE(h->hp == 1.f);
+					health_removed++;
+					admin.DestroyEntity(e.GetEntityID());
+				});
+				const EntityID id2 = e2.GetEntityID();
+				const size_t live = admin.EntityAllocatorStats().live;
+				e2.Remove<HealthComponent>();
+				REQUIRE(health_removed == 1);
+				REQUIRE(!admin.IsAlive(id2));
+				REQUIRE((removed == std::vector<float>{ 2.f }));
+				REQUIRE(health_component_count == 0);
+				REQUIRE(admin.GetAllComponents<PositionComponent>().size() == 1);
+				REQUIRE(admin.EntityAllocatorStats().live == live);
+				admin.Update(0.f);
+				REQUIRE(admin.EntityAllocatorStats().live == live - 1);
+				admin.CreateEntity<Entity>().Add<HealthComponent>(1.f, 1.f);
+				admin.RemoveAll<HealthComponent>();
+				REQUIRE(health_removed == 2);
+				REQUIRE(admin.EntityCount() == 1);
+			}
+			THEN("Entities spawned by observers during a bulk destroy do not take the dying slots") {
+				CachedQuery<Transform>& query = admin.Query<Transform>();
+				std::vector<EntityID> ids = admin.CreateEntities<Transform>(3000);
+				int spawned = 0;
+				admin.OnRemove<Transform>([&admin, &spawned](Entity&, Transform*) {
+					if (spawned < 2000) {
+						spawned++;
+						admin.CreateEntity<Entity>().Add<Transform>(1.f, 0.f, 0.f);
+					}
+				});
+				admin.DestroyEntities(ids);
+				ComponentStorage<Transform>& storage = admin.GetAllComponents<Transform>();
+				REQUIRE(storage.size() == 2000);
+				REQUIRE(query.size() == 2000);
+				int stale = 0;
+				for (size_t i = 0; i < storage.size(); ++i) {
+					stale += admin.FindEntity(storage.Owner(i)->GetEntityID()) == storage.Owner(i) ? 0 : 1;
+				}
+				for (Entity* ent : query.Entities()) {
+					stale += admin.FindEntity(ent->GetEntityID()) == ent ? 0 : 1;
+				}
+				REQUIRE(stale == 0);
+			}
+			THEN("Observers can register more observers from a callback") {
+				int nested = 0;
+				admin.OnAdd<HealthComponent>([&admin, &nested](Entity&, HealthComponent*) {
+					admin.OnAdd<HealthComponent>([&nested](Entity&, HealthComponent*) { nested++; });
+					admin.OnAdd<Transform>([](Entity&, Transform*) {});
+					admin.OnAdd<Velocity>([](Entity&, Velocity*) {});
+					admin.OnAdd<UnitStats>([](Entity&, UnitStats*) {});
+					admin.OnAdd<FrameClock>([](Entity&, FrameClock*) {});
+					admin.OnAdd<Gravity>([](Entity&, Gravity*) {});
+					admin.OnAdd<DeadTag>([](Entity&, DeadTag*) {});
+					admin.OnAdd<UnusedComponent>([](Entity&, UnusedComponent*) {});
+					admin.OnAdd<MovementComponent>([](Entity&, MovementComponent*) {});
+				});
+				e1.Add<HealthComponent>(1.f, 1.f);
+				REQUIRE(nested == 1);
+			}
+			THEN("Commands recorded by an observer during playback wait for the next playback") {
+				admin.OnAdd<HealthComponent>([&admin](Entity& e, HealthComponent* h) {
+					for (int i = 0; i < 64; ++i) {
+						admin.Commands().Add<HealthComponent>(e.GetEntityID(), h->hp + 1.f, float(i));
+					}
+				});
+				admin.Commands().Add<HealthComponent>(e1.GetEntityID(), 1.f, 1.f);
+				admin.PlaybackCommands();
+				REQUIRE(e1.Get<HealthComponent>()->hp == 1.f);
+				REQUIRE(admin.Commands().size() == 64);
+				admin.PlaybackCommands();
+				REQUIRE(e1.Get<HealthComponent>()->hp == 2.f);
+				REQUIRE(e1.Get<HealthComponent>()->mana == 63.f);
+				REQUIRE(admin.Commands().empty());
+			}
+			THEN("Deferred observers get one batch at the sync point") {
+				std::vector<std::vector<EntityID>> batches;
+				admin.ObserveDeferred<HealthComponent>(ComponentEvent::kRemove, [&batches](const std::vector<EntityID>& ids) { batches.push_back(ids); });
+				Entity& e3 = admin.CreateEntity<Entity>().Add<HealthComponent>(1.f, 1.f);
+				const EntityID id2 = e2.GetEntityID();
+				const EntityID id3 = e3.GetEntityID();
+				e3.Remove<HealthComponent>();
+				admin.DestroyEntity(id2);
+				REQUIRE(batches.empty());
+				admin.Update(0.f);
+				REQUIRE((batches == std::vector<std::vector<EntityID>>{ { id3, id2 } }));
+				admin.Update(0.f);
+				REQUIRE(batches.size() == 1);
+			}
+		}
+
+		GIVEN("A reactive query") {
+			Entity& e1 = admin.CreateEntity<Entity>().Add<PositionComponent>(0.f, 0.f, 0.f);
+			Entity& e2 = admin.CreateEntity<Entity>().Add<PositionComponent>(0.f, 0.f, 0.f).Add<DeadTag>();
+			ReactiveQuery<PositionComponent, Exclude<DeadTag>>& query = admin.Reactive<PositionComponent, Exclude<DeadTag>>();
+			std::vector<EntityID> added;
+			std::vector<EntityID> removed;
+			THEN("It reports the net change since the last poll") {
+				REQUIRE((query.Added() == std::vector<EntityID>{ e1.GetEntityID() }));
+				query.Poll(added, removed);
+				REQUIRE(added.size() == 1);
+				REQUIRE(removed.empty());
+				query.Poll(added, removed);
+				REQUIRE((added.empty() && removed.empty()));
+
+				const EntityID id1 = e1.GetEntityID();
+				Entity& e3 = admin.CreateEntity<Entity>().Add<PositionComponent>(0.f, 0.f, 0.f);
+				Entity& e4 = admin.CreateEntity<Entity>().Add<PositionComponent>(0.f, 0.f, 0.f);
+				e2.Remove<DeadTag>();
+				admin.DestroyEntity(id1);
+				e4.Add<DeadTag>();
+				e3.Remove<PositionComponent>().Add<PositionComponent>(1.f, 1.f, 1.f);
+				query.Poll(added, removed);
+				std::sort(added.begin(), added.end());
+				REQUIRE((added == std::vector<EntityID>{ e2.GetEntityID(), e3.GetEntityID() }));
+				REQUIRE((removed == std::vector<EntityID>{ id1 }));
+				REQUIRE(query.size() == 2);
+
+				//the slot of e1 is reused by a new entity once enough slots are free
+				std::vector<EntityID> spare = admin.CreateEntities<MovementComponent>(ECS_MIN_FREE_ENTITY_SLOTS);
+				admin.DestroyEntities(spare);
+				Entity& e5 = admin.CreateEntity<Entity>().Add<PositionComponent>(0.f, 0.f, 0.f);
+				REQUIRE(EntityIndex(e5.GetEntityID()) == EntityIndex(id1));
+				admin.DestroyEntity(e5.GetEntityID());
+				e3.Add<DeadTag>();
+				query.Poll(added, removed);
+				REQUIRE(added.empty());
+				REQUIRE((removed == std::vector<EntityID>{ e3.GetEntityID() }));
+			}
+		}
+
+		GIVEN("Systems tracking changes") {
+			MarchSystem& march = admin.CreateSystem<MarchSystem>();
+			MovedReportSystem& report = admin.CreateSystem<MovedReportSystem>();
+			std::vector<Entity*> entities;
+			for (int i = 0; i < 10; ++i)
+			{
+				Entity& e = admin.CreateEntity<Entity>().Add<Transform>(0.f, 0.f, 0.f);
+				if (i % 2 == 0)
+				{
+					e.Add<Velocity>(1.f, 0.f);
+				}
+				entities.push_back(&e);
+			}
+			THEN("Changed terms only see the components written since the last run") {
+				REQUIRE(march.LastRunVersion() == 0);
+				admin.Update(1.f);
+				REQUIRE(report.moved == 10);
+				REQUIRE(report.LastRunVersion() > march.LastRunVersion());
+				admin.Update(1.f);
+				REQUIRE(report.moved == 5);
+				REQUIRE(entities[0]->Get<Transform>()->x == 2.f);
+				entities[1]->Modify<Transform>();
+				entities[3]->Replace<Transform>(1.f, 1.f, 1.f);
+				admin.Update(1.f);
+				REQUIRE(report.moved == 7);
+				admin.SetScheduleMode(ScheduleMode::kParallel, 2);
+				admin.Update(1.f);
+				REQUIRE(report.moved == 5);
+			}
+			THEN("Queries outside of systems see every component") {
+				admin.Update(1.f);
+				admin.Update(1.f);
+				int count = 0;
+				for (Transform* t : ComponentItr<Changed<Transform>>(&admin)) {
+					(void)t;
+					count++;
+				}
+				REQUIRE(count == 10);
+				REQUIRE(admin.VersionOf(entities[0], details::ComponentIndex::index<Transform>()) > admin.VersionOf(entities[1], details::ComponentIndex::index<Transform>()));
+			}
+			THEN("Cached queries record the writes of Mut terms") {
+				admin.Update(1.f);
+				auto& query = admin.Query<Mut<Transform>, Exclude<Velocity>>();
+				query.ForEach([](Transform* t) { t->y = 1.f; });
+				admin.Update(1.f);
+				REQUIRE(report.moved == 10);
 			}
 		}
 
@@ -329,5 +1311,275 @@ SCENARIO("Testing ecs framework, unittests") {
 				}
 			}
 		}
+
+		GIVEN("Systems declaring the components they read and write") {
+			MoveSystem& move = admin.CreateSystem<MoveSystem>();
+			RegenSystem& regen = admin.CreateSystem<RegenSystem>();
+			HealthReportSystem& report = admin.CreateSystem<HealthReportSystem>();
+			for (int i = 0; i < 100; ++i) {
+				admin.CreateEntity<Entity>().Add<MovementComponent>(2.f).Add<PositionComponent>(0.f, 0.f, 0.f).Add<HealthComponent>(1.f, 0.f);
+			}
+			THEN("Only conflicting systems depend on each other") {
+				REQUIRE(!move.ConflictsWith(regen));
+				REQUIRE(report.ConflictsWith(regen));
+				REQUIRE(admin.Scheduler().Dependencies(1).empty());
+				REQUIRE((admin.Scheduler().Dependencies(2) == std::vector<size_t>{ 1 }));
+				DemoSystem& demo = admin.CreateSystem<DemoSystem>();
+				REQUIRE(demo.Exclusive());
+				REQUIRE((admin.Scheduler().Dependencies(3) == std::vector<size_t>{ 0, 1, 2 }));
+			}
+			WHEN("Updating on a worker pool") {
+				admin.SetScheduleMode(ScheduleMode::kParallel, 3);
+				for (int frame = 0; frame < 10; ++frame) {
+					admin.Update(0.5f);
+				}
+				THEN("Every system ran in dependency order") {
+					REQUIRE(admin.Scheduler().ThreadCount() == 3);
+					REQUIRE(report.total_hp == 1100.f);
+					for (PositionComponent* p : ComponentItr<PositionComponent>(&admin)) {
+						REQUIRE(p->x == 10.f);
+					}
+				}
+			}
+			WHEN("Iterating a query in parallel") {
+				admin.SetScheduleMode(ScheduleMode::kParallel, 3);
+				for (int i = 0; i < 10000; ++i) {
+					admin.CreateEntity<Entity>().Add<MovementComponent>(1.f).Add<PositionComponent>(0.f, 0.f, 0.f);
+				}
+				CachedQuery<MovementComponent, PositionComponent>& query = admin.Query<MovementComponent, PositionComponent>();
+				query.ParallelForEach(admin.Workers(), [](MovementComponent* m, PositionComponent* p) { p->x += m->velocity; }, 256);
+				int visited = query.ParallelForEach(admin.Workers(), 0,
+					[](int& count, MovementComponent*, PositionComponent*) { ++count; },
+					[](int& into, const int& from) { into += from; }, 256);
+				THEN("Every entity is visited once and the scratch values are reduced") {
+					REQUIRE(visited == 10100);
+					float x = query.ParallelForEach(nullptr, 0.f,
+						[](float& sum, MovementComponent*, PositionComponent* p) { sum += p->x; },
+						[](float& into, const float& from) { into += from; });
+					REQUIRE(x == 10000.f + 100.f * 2.f);
+				}
+			}
+			WHEN("Recording commands from worker threads") {
+				admin.SetScheduleMode(ScheduleMode::kParallel, 3);
+				CachedQuery<MovementComponent, PositionComponent>& query = admin.Query<MovementComponent, PositionComponent>();
+				query.ParallelForEach(admin.Workers(), [&admin](MovementComponent* m, PositionComponent*) {
+					admin.Commands().Remove<PositionComponent>(m->Owner()->GetEntityID());
+				}, 8);
+				admin.Update(0.f);
+				THEN("The update plays every thread's buffer back") {
+					REQUIRE(query.empty());
+					REQUIRE(position_component_count == 0);
+				}
+			}
+			WHEN("Removing a system and updating sequentially") {
+				admin.RemoveSystem<RegenSystem>();
+				admin.SetScheduleMode(ScheduleMode::kSequential);
+				admin.Update(1.f);
+				THEN("The remaining systems still run") {
+					REQUIRE(admin.Scheduler().Systems().size() == 2);
+					REQUIRE(report.total_hp == 100.f);
+				}
+			}
+		}
+	}
+}
+
+SCENARIO("Testing archetype storage mode") {
+	GIVEN("An EntityAdmin in archetype mode") {
+		EntityAdmin admin(StorageMode::kArchetype);
+		movement_component_count = 0;
+		health_component_count = 0;
+		position_component_count = 0;
+
+		Entity& entity1 = admin.CreateEntity<Entity>();
+		Entity& entity2 = admin.CreateEntity<Entity>();
+		Entity& entity3 = admin.CreateEntity<Entity>();
+		entity1.Add<MovementComponent>(11.f).Add<HealthComponent>(10.f, 20.f);
+		entity2.Add<MovementComponent>(22.f).Add<HealthComponent>(30.f, 40.f).Add<PositionComponent>(1.f, 2.f, 3.f);
+		entity3.Add<MovementComponent>(33.f);
+
+		THEN("Components keep their values while entities move between archetypes") {
+			REQUIRE(entity1.Get<MovementComponent>()->velocity == 11.f);
+			REQUIRE(entity2.Get<HealthComponent>()->mana == 40.f);
+			REQUIRE(entity2.Get<PositionComponent>()->Owner() == &entity2);
+			REQUIRE(entity2.Get<PositionComponent>()->Sibling<MovementComponent>()->velocity == 22.f);
+			REQUIRE(admin.GetArchetypes().size() == 3);
+		}
+		THEN("Transient components created in bulk are removed by Update") {
+			std::vector<EntityID> ids = admin.CreateEntities<PositionComponent, HitMarkerComponent>(10);
+			CachedQuery<HitMarkerComponent>& query = admin.Query<HitMarkerComponent>();
+			REQUIRE(query.size() == 10);
+			admin.Update(0.f);
+			REQUIRE(query.empty());
+			REQUIRE(!admin.FindEntity(ids[0])->Has<HitMarkerComponent>());
+			REQUIRE(admin.FindEntity(ids[0])->Has<PositionComponent>());
+		}
+		THEN("Iterating MovementComponent visits every archetype that has it") {
+			float sum = 0.f;
+			for (MovementComponent* m : ComponentItr<MovementComponent>(&admin)) {
+				sum += m->velocity;
+			}
+			REQUIRE(sum == 66.f);
+		}
+		THEN("Iterating MovementComponent And HealthComponent visits only matching chunks") {
+			int count = 0;
+			for (auto&& t : ComponentItr<MovementComponent, HealthComponent>(&admin,
+				[](const MovementComponent* m, const HealthComponent* h) -> bool { return h->hp > 5.f; })) {
+				REQUIRE(std::get<0>(t)->Owner() == std::get<1>(t)->Owner());
+				count++;
+			}
+			REQUIRE(count == 2);
+		}
+		THEN("Exclude skips whole archetypes and Optional columns may be missing") {
+			int count = 0;
+			for (MovementComponent* m : ComponentItr<MovementComponent, Exclude<PositionComponent>>(&admin)) {
+				REQUIRE(m->Owner() != &entity2);
+				count++;
+			}
+			REQUIRE(count == 2);
+			count = 0;
+			float x = 0.f;
+			for (auto&& t : ComponentItr<Optional<PositionComponent>, MovementComponent>(&admin)) {
+				x += std::get<0>(t) ? std::get<0>(t)->x : 0.f;
+				count++;
+			}
+			REQUIRE(count == 3);
+			REQUIRE(x == 1.f);
+		}
+		WHEN("Creating entities in bulk") {
+			std::vector<EntityID> ids = admin.CreateEntities<MovementComponent, HealthComponent>(1000,
+				[](size_t i, MovementComponent* m, HealthComponent* h) {
+					m->velocity = 1.f;
+					h->Reset(float(i), 0.f);
+				});
+			THEN("They go straight into the archetype of their components") {
+				REQUIRE(admin.GetArchetypes().size() == 3);
+				REQUIRE(admin.FindEntity(ids[10])->Get<HealthComponent>()->hp == 10.f);
+				int count = 0;
+				for (MovementComponent* m : ComponentItr<MovementComponent, Exclude<PositionComponent>>(&admin)) {
+					count += m->velocity == 1.f ? 1 : 0;
+				}
+				REQUIRE(count == 1000);
+				admin.DestroyEntity(ids[0]);
+				REQUIRE(admin.FindEntity(ids[999])->Get<HealthComponent>()->hp == 999.f);
+			}
+		}
+		WHEN("Removing a component type from every archetype") {
+			admin.RemoveAll<HealthComponent>();
+			THEN("The entities move to the archetypes without it") {
+				REQUIRE(health_component_count == 0);
+				REQUIRE(!entity2.Has<HealthComponent>());
+				REQUIRE(entity2.Get<PositionComponent>()->z == 3.f);
+				REQUIRE(entity1.Get<MovementComponent>()->velocity == 11.f);
+				admin.DestroyEntities(std::vector<EntityID>{ entity1.GetEntityID(), entity3.GetEntityID() });
+				REQUIRE(movement_component_count == 1);
+				REQUIRE(entity2.Get<MovementComponent>()->velocity == 22.f);
+			}
+		}
+		WHEN("Removing and replacing components") {
+			entity1.Remove<HealthComponent>();
+			entity2.Replace<HealthComponent>(50.f, 60.f);
+			THEN("Entities see the updated component set") {
+				REQUIRE(!entity1.Has<HealthComponent>());
+				REQUIRE(entity1.Get<MovementComponent>()->velocity == 11.f);
+				REQUIRE(entity2.Get<HealthComponent>()->hp == 50.f);
+				REQUIRE(health_component_count == 1);
+			}
+		}
+		WHEN("Tagging entities") {
+			entity1.Add<PlayerTag>();
+			entity2.Add<PlayerTag>().Add<DeadTag>();
+			THEN("They stay in their archetypes and queries test the tags per entity") {
+				REQUIRE(admin.GetArchetypes().size() == 3);
+				int count = 0;
+				for (MovementComponent* m : ComponentItr<MovementComponent, PlayerTag, Exclude<DeadTag>>(&admin)) {
+					REQUIRE(m->Owner() == &entity1);
+					count++;
+				}
+				REQUIRE(count == 1);
+				entity2.Remove<MovementComponent>();
+				REQUIRE((entity2.Has<PlayerTag, DeadTag>()));
+				admin.RemoveAll<DeadTag>();
+				REQUIRE(!entity2.Has<DeadTag>());
+			}
+		}
+		WHEN("Adding plain struct components") {
+			entity1.Add<Transform>(1.f, 2.f, 3.f);
+			entity2.Add<Transform>(4.f, 5.f, 6.f).Add<Velocity>(1.f, 1.f);
+			entity1.Remove<HealthComponent>();
+			THEN("They move between archetypes with their values") {
+				REQUIRE(entity1.Get<Transform>()->z == 3.f);
+				REQUIRE(entity2.Get<Transform>()->x == 4.f);
+				REQUIRE(entity2.Get<PositionComponent>()->Sibling<Velocity>()->dx == 1.f);
+				int count = 0;
+				for (Transform* t : ComponentItr<Transform, Exclude<Velocity>>(&admin)) {
+					REQUIRE(t->y == 2.f);
+					count++;
+				}
+				REQUIRE(count == 1);
+			}
+		}
+		WHEN("Adding shared components") {
+			entity1.Add<Shared<UnitStats>>(10, 1);
+			entity2.Add<Shared<UnitStats>>(10, 1);
+			entity3.Add<Shared<UnitStats>>(20, 2);
+			entity1.Remove<HealthComponent>();
+			THEN("Handles move between archetypes and keep the values alive") {
+				REQUIRE(entity1.Get<Shared<UnitStats>>()->get() == entity2.Get<Shared<UnitStats>>()->get());
+				REQUIRE(entity1.Get<Shared<UnitStats>>()->UseCount() == 2);
+				admin.DestroyEntity(entity3.GetEntityID());
+				REQUIRE(admin.GetSharedValues<UnitStats>().size() == 1);
+			}
+		}
+		WHEN("Observing components") {
+			int added = 0;
+			float removed = 0.f;
+			admin.OnAdd<Transform>([&added](Entity&, Transform*) { added++; });
+			admin.OnRemove<Transform>([&removed](Entity&, Transform* t) { removed += t->x; });
+			entity1.Add<Transform>(1.f, 2.f, 3.f);
+			entity2.Add<Transform>(4.f, 5.f, 6.f);
+			THEN("An observer can destroy the entity whose component is removed") {
+				admin.OnRemove<MovementComponent>([&admin](Entity& e, MovementComponent*) { admin.DestroyEntity(e.GetEntityID()); });
+				entity1.Remove<MovementComponent>();
+				REQUIRE(removed == 1.f);
+				REQUIRE(health_component_count == 1);
+				REQUIRE(movement_component_count == 2);
+				REQUIRE(entity2.Get<Transform>()->x == 4.f);
+			}
+			THEN("Moves between archetypes do not notify") {
+				entity1.Remove<HealthComponent>();
+				REQUIRE(added == 2);
+				admin.DestroyEntity(entity2.GetEntityID());
+				entity1.Remove<Transform>();
+				REQUIRE(removed == 5.f);
+			}
+		}
+		WHEN("Systems track changes") {
+			MovedReportSystem& report = admin.CreateSystem<MovedReportSystem>();
+			admin.CreateSystem<MarchSystem>();
+			entity1.Add<Transform>(1.f, 2.f, 3.f);
+			entity2.Add<Transform>(4.f, 5.f, 6.f).Add<Velocity>(1.f, 1.f);
+			entity3.Add<Transform>(7.f, 8.f, 9.f);
+			THEN("Chunks without writes are skipped") {
+				admin.Update(1.f);
+				REQUIRE(report.moved == 3);
+				admin.Update(1.f);
+				REQUIRE(report.moved == 1);
+				entity3.Modify<Transform>();
+				entity1.Remove<HealthComponent>();
+				admin.Update(1.f);
+				REQUIRE(report.moved == 2);
+				REQUIRE(entity2.Get<Transform>()->x == 7.f);
+			}
+		}
+		WHEN("Destroying an entity") {
+			admin.DestroyEntity(entity1.GetEntityID());
+			THEN("Its components are destroyed and the others stay valid") {
+				REQUIRE(movement_component_count == 2);
+				REQUIRE(health_component_count == 1);
+				REQUIRE(entity2.Get<MovementComponent>()->velocity == 22.f);
+				REQUIRE(entity3.Get<MovementComponent>()->velocity == 33.f);
+			}
+		}
 	}
 }